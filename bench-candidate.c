@@ -0,0 +1,266 @@
+/* hanja candidate window benchmark
+ *
+ * Opens the candidate window of a word with the hanja key, pages through
+ * all of its candidates and back with Page_Down and Page_Up, and closes it
+ * with Escape, all through the key processing of the module. Reports the
+ * time the module takes for each step and the time until the candidate
+ * window has painted the result, from the frame clock of the window.
+ *
+ * The word is given to the module as the surrounding text of the client,
+ * like a word typed before. The candidate window is a popup window, so it
+ * appears on the display:
+ *   xvfb-run ./bench-candidate -s 정 -n 200
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <gtk/gtk.h>
+#include <gdk/gdkkeysyms.h>
+
+#include "gtkimcontexthangul.h"
+#include "bench.h"
+
+/* candidates on a page of the candidate window, see popup_candidate_window */
+#define N_PER_PAGE 9
+
+/* give up waiting for a frame after this, the window may not be mapped */
+#define FRAME_TIMEOUT_MS 1000
+
+static gchar   *opt_word = "기";
+static gint     opt_rounds = 100;
+
+static const GOptionEntry entries[] = {
+    { "word", 's', 0, G_OPTION_ARG_STRING, &opt_word,
+      "word before the cursor to look up (default: 기)", "WORD" },
+    { "rounds", 'n', 0, G_OPTION_ARG_INT, &opt_rounds,
+      "open, page through and close the window N times", "N" },
+    { NULL }
+};
+
+static gboolean
+on_retrieve_surrounding (GtkIMContext *context, gpointer data)
+{
+    const gchar *word = data;
+
+    gtk_im_context_set_surrounding (context, word, -1, strlen (word));
+    return TRUE;
+}
+
+static void
+on_after_paint (GdkFrameClock *clock, gboolean *painted)
+{
+    *painted = TRUE;
+}
+
+static gboolean
+on_frame_timeout (gpointer data)
+{
+    gboolean *timed_out = data;
+
+    *timed_out = TRUE;
+    return FALSE;
+}
+
+/* the popup window which is not the client toplevel */
+static GtkWidget*
+find_candidate_window (BenchClient *client)
+{
+    GList *list;
+    GList *item;
+    GtkWidget *window = NULL;
+
+    list = gtk_window_list_toplevels ();
+    for (item = list; item != NULL; item = item->next) {
+	GtkWindow *toplevel = item->data;
+
+	if (GTK_WIDGET (toplevel) != client->toplevel &&
+	    gtk_window_get_window_type (toplevel) == GTK_WINDOW_POPUP &&
+	    gtk_widget_get_visible (GTK_WIDGET (toplevel))) {
+	    window = GTK_WIDGET (toplevel);
+	    break;
+	}
+    }
+    g_list_free (list);
+
+    return window;
+}
+
+/* runs the main loop until a frame is painted, sets the time of it and
+ * returns TRUE, or returns FALSE if no frame came in time */
+static gboolean
+wait_for_frame (gboolean *painted, guint64 *end)
+{
+    gboolean timed_out = FALSE;
+    guint timeout_id;
+
+    timeout_id = g_timeout_add (FRAME_TIMEOUT_MS, on_frame_timeout, &timed_out);
+    while (!*painted && !timed_out)
+	g_main_context_iteration (NULL, TRUE);
+    if (!timed_out)
+	g_source_remove (timeout_id);
+
+    if (!*painted) {
+	g_printerr ("no frame from the candidate window in %d ms\n",
+		    FRAME_TIMEOUT_MS);
+	return FALSE;
+    }
+
+    *end = bench_now_ns ();
+    return TRUE;
+}
+
+/* presses a key and returns the time the module took for it */
+static guint64
+press (BenchClient *client, guint keyval)
+{
+    BenchKey key;
+    guint64 start;
+
+    bench_key_from_keyval (&key, keyval);
+    start = bench_now_ns ();
+    bench_client_press (client, &key);
+    return bench_now_ns () - start;
+}
+
+int
+main (int argc, char *argv[])
+{
+    GOptionContext *option_context;
+    GError *error = NULL;
+    GTypeModule *module;
+    BenchClient *client;
+    HanjaTable *table;
+    HanjaList *list;
+    GArray *open_samples;
+    GArray *first_frame_samples;
+    GArray *flip_samples;
+    GArray *flip_frame_samples;
+    GArray *close_samples;
+    gint n_candidates;
+    gint n_flips;
+    gint n_missed = 0;
+    gint round;
+    gint i;
+
+    gtk_init (&argc, &argv);
+
+    option_context = g_option_context_new ("- page through hanja candidates");
+    g_option_context_add_main_entries (option_context, entries, NULL);
+    if (!g_option_context_parse (option_context, &argc, &argv, &error)) {
+	g_printerr ("%s\n", error->message);
+	return 1;
+    }
+    g_option_context_free (option_context);
+
+    /* the number of pages, the module shows the same list */
+    table = hanja_table_load (NULL);
+    if (table == NULL) {
+	g_printerr ("can't load the hanja table\n");
+	return 1;
+    }
+    list = hanja_table_match_suffix (table, opt_word);
+    if (list == NULL) {
+	g_printerr ("no hanja for %s\n", opt_word);
+	return 1;
+    }
+    n_candidates = hanja_list_get_size (list);
+    n_flips = (n_candidates - 1) / N_PER_PAGE;
+    hanja_list_delete (list);
+    hanja_table_delete (table);
+
+    module = bench_module_load ();
+    client = bench_client_new ("2");
+    g_signal_connect (client->context, "retrieve-surrounding",
+		      G_CALLBACK (on_retrieve_surrounding), opt_word);
+
+    open_samples = bench_samples_new (opt_rounds);
+    first_frame_samples = bench_samples_new (opt_rounds);
+    flip_samples = bench_samples_new (opt_rounds * n_flips * 2);
+    flip_frame_samples = bench_samples_new (opt_rounds * n_flips * 2);
+    close_samples = bench_samples_new (opt_rounds);
+
+    for (round = 0; round < opt_rounds; round++) {
+	GtkWidget *window;
+	GdkFrameClock *clock;
+	gboolean painted = FALSE;
+	guint64 start;
+	guint64 end;
+	guint64 elapsed;
+	gulong handler;
+
+	start = bench_now_ns ();
+	elapsed = press (client, GDK_KEY_Hangul_Hanja);
+	g_array_append_val (open_samples, elapsed);
+
+	window = find_candidate_window (client);
+	if (window == NULL) {
+	    g_printerr ("the candidate window did not open\n");
+	    return 1;
+	}
+
+	clock = gtk_widget_get_frame_clock (window);
+	handler = g_signal_connect (clock, "after-paint",
+				    G_CALLBACK (on_after_paint), &painted);
+
+	/* a missed frame would add the whole timeout to the samples */
+	if (wait_for_frame (&painted, &end)) {
+	    elapsed = end - start;
+	    g_array_append_val (first_frame_samples, elapsed);
+	} else {
+	    n_missed++;
+	}
+
+	for (i = 0; i < n_flips * 2; i++) {
+	    painted = FALSE;
+	    start = bench_now_ns ();
+	    elapsed = press (client, i < n_flips ? GDK_KEY_Page_Down
+						 : GDK_KEY_Page_Up);
+	    g_array_append_val (flip_samples, elapsed);
+
+	    if (wait_for_frame (&painted, &end)) {
+		elapsed = end - start;
+		g_array_append_val (flip_frame_samples, elapsed);
+	    } else {
+		n_missed++;
+	    }
+	}
+
+	g_signal_handler_disconnect (clock, handler);
+
+	elapsed = press (client, GDK_KEY_Escape);
+	g_array_append_val (close_samples, elapsed);
+
+	/* let the destroyed window go before the next round */
+	while (g_main_context_pending (NULL))
+	    g_main_context_iteration (NULL, FALSE);
+    }
+
+    printf ("word                %s\n", opt_word);
+    printf ("candidates          %d (%d pages)\n",
+	    n_candidates, n_flips + 1);
+    printf ("rounds              %d\n", opt_rounds);
+    printf ("missed frames       %d (not in the samples)\n", n_missed);
+    bench_samples_print ("open", open_samples);
+    bench_samples_print ("open to frame", first_frame_samples);
+    bench_samples_print ("page flip", flip_samples);
+    bench_samples_print ("page flip to frame", flip_frame_samples);
+    bench_samples_print ("close", close_samples);
+
+    g_array_free (close_samples, TRUE);
+    g_array_free (flip_frame_samples, TRUE);
+    g_array_free (flip_samples, TRUE);
+    g_array_free (first_frame_samples, TRUE);
+    g_array_free (open_samples, TRUE);
+    bench_client_free (client);
+    bench_module_unload (module);
+
+    return 0;
+}
+
+/* vim: set sw=4 : */
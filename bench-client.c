@@ -0,0 +1,295 @@
+/* im module and client widget helpers for the imhangul benchmark programs
+ *
+ * The benchmark programs link the im module sources directly and load them
+ * through a GTypeModule of their own, so they run the same code GTK+ runs
+ * when it loads im-hangul.so, without needing an installed module. */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <string.h>
+
+#include <gtk/gtk.h>
+#include <gdk/gdkkeysyms.h>
+
+#include "gtkimcontexthangul.h"
+#include "bench.h"
+
+/* GTypeModule for the statically linked im module */
+typedef GTypeModule      BenchModule;
+typedef GTypeModuleClass BenchModuleClass;
+
+static gboolean
+bench_module_type_load (GTypeModule *module)
+{
+    im_module_init (module);
+    return TRUE;
+}
+
+static void
+bench_module_type_unload (GTypeModule *module)
+{
+    im_module_exit ();
+}
+
+static void
+bench_module_class_init (BenchModuleClass *klass)
+{
+    GTypeModuleClass *module_class = G_TYPE_MODULE_CLASS (klass);
+
+    module_class->load = bench_module_type_load;
+    module_class->unload = bench_module_type_unload;
+}
+
+static GType
+bench_module_get_type (void)
+{
+    static GType type = 0;
+
+    if (type == 0) {
+	static const GTypeInfo info = {
+	    sizeof (BenchModuleClass),
+	    (GBaseInitFunc) NULL,
+	    (GBaseFinalizeFunc) NULL,
+	    (GClassInitFunc) bench_module_class_init,
+	    NULL,
+	    NULL,
+	    sizeof (BenchModule),
+	    0,
+	    (GInstanceInitFunc) NULL,
+	};
+
+	type = g_type_register_static (G_TYPE_TYPE_MODULE,
+				       "ImHangulBenchModule", &info, 0);
+    }
+
+    return type;
+}
+
+GTypeModule*
+bench_module_load (void)
+{
+    GTypeModule *module;
+
+    /* do not let the user's ~/.imhangul.conf change the numbers, and keep
+     * the entries of the client widgets from loading an installed copy
+     * of this module */
+    g_setenv ("IM_HANGUL_CONF_FILE", "/dev/null", FALSE);
+    g_setenv ("GTK_IM_MODULE", "gtk-im-context-simple", TRUE);
+
+    module = g_object_new (bench_module_get_type (), NULL);
+    g_type_module_set_name (module, "im-hangul");
+    g_type_module_use (module);
+
+    return module;
+}
+
+void
+bench_module_unload (GTypeModule *module)
+{
+    /* GTypeModules are never finalized, so we only drop the use count */
+    g_type_module_unuse (module);
+}
+
+/* client widget */
+static void
+bench_client_on_commit (GtkIMContext *context, const gchar *str,
+			BenchClient *client)
+{
+    client->n_commits++;
+    client->n_commit_bytes += strlen (str);
+}
+
+static void
+bench_client_on_preedit_changed (GtkIMContext *context, BenchClient *client)
+{
+    gchar *str = NULL;
+    PangoAttrList *attrs = NULL;
+    gint cursor_pos = 0;
+    guint64 *counter;
+
+    /* GtkEntry and GtkTextView ask for the preedit string on every change,
+     * the allocations of this query are counted apart from the key press */
+    client->n_preedit_changed++;
+    counter = bench_alloc_count_into (&client->n_query_allocs);
+    gtk_im_context_get_preedit_string (context, &str, &attrs, &cursor_pos);
+    bench_alloc_count_into (counter);
+    g_free (str);
+    pango_attr_list_unref (attrs);
+}
+
+BenchClient*
+bench_client_new (const gchar *keyboard)
+{
+    BenchClient *client;
+    BenchKey key;
+    gchar *context_id;
+
+    client = g_new0 (BenchClient, 1);
+
+    /* an offscreen window is realized like a normal toplevel,
+     * but it never appears on the screen */
+    client->toplevel = gtk_offscreen_window_new ();
+    client->entry = gtk_entry_new ();
+    gtk_container_add (GTK_CONTAINER (client->toplevel), client->entry);
+    gtk_widget_show_all (client->toplevel);
+
+    context_id = g_strconcat ("hangul", keyboard, NULL);
+    client->context = im_module_create (context_id);
+    g_free (context_id);
+
+    g_signal_connect (client->context, "commit",
+		      G_CALLBACK (bench_client_on_commit), client);
+    g_signal_connect (client->context, "preedit-changed",
+		      G_CALLBACK (bench_client_on_preedit_changed), client);
+
+    gtk_im_context_set_client_window (client->context,
+			    gtk_widget_get_window (client->entry));
+    gtk_im_context_focus_in (client->context);
+
+    /* every toplevel starts in direct mode */
+    bench_key_from_keyval (&key, GDK_KEY_Hangul);
+    bench_client_press (client, &key);
+
+    return client;
+}
+
+void
+bench_client_free (BenchClient *client)
+{
+    if (client == NULL)
+	return;
+
+    gtk_im_context_focus_out (client->context);
+    gtk_im_context_set_client_window (client->context, NULL);
+    g_object_unref (client->context);
+    gtk_widget_destroy (client->toplevel);
+    g_free (client);
+}
+
+/* Feeds one key press the way GTK+ delivers it: the module sees the key
+ * first, and if it does not consume it the widget passes it to
+ * gtk_im_context_filter_keypress(). */
+gboolean
+bench_context_press (GtkIMContext *context, GdkWindow *window,
+		     const BenchKey *key)
+{
+    GdkEventKey event;
+    gboolean res;
+
+    memset (&event, 0, sizeof (event));
+    event.type = GDK_KEY_PRESS;
+    event.window = window;
+    event.keyval = key->keyval;
+    event.state = key->state;
+    event.hardware_keycode = key->keycode;
+
+    res = gtk_im_context_hangul_filter_keypress (
+			GTK_IM_CONTEXT_HANGUL (context), &event);
+    if (!res)
+	res = gtk_im_context_filter_keypress (context, &event);
+
+    return res;
+}
+
+gboolean
+bench_client_press (BenchClient *client, const BenchKey *key)
+{
+    return bench_context_press (client->context,
+				gtk_widget_get_window (client->entry), key);
+}
+
+/* key streams
+ *
+ * A key stream is plain text. Every printable ASCII character is the key
+ * which produces it on a US qwerty keyboard. Line breaks are ignored, so
+ * long streams can be wrapped, and these escapes are recognized:
+ *   \n  Return       \t  Tab          \b  BackSpace
+ *   \e  Escape       \h  Hangul       \j  Hangul_Hanja
+ *   \\  backslash
+ */
+void
+bench_key_from_keyval (BenchKey *key, guint keyval)
+{
+    GdkKeymap *keymap;
+    GdkKeymapKey *keys = NULL;
+    gint n_keys = 0;
+    gint i;
+
+    key->keyval = keyval;
+    key->state = 0;
+    key->keycode = 0;
+
+    /* ask the X server which key would send this keyval,
+     * so the built-in keycode table of the module is exercised too */
+    keymap = gdk_keymap_get_default ();
+    if (gdk_keymap_get_entries_for_keyval (keymap, keyval, &keys, &n_keys)) {
+	for (i = 0; i < n_keys; i++) {
+	    if (keys[i].group == 0 && keys[i].level <= 1) {
+		key->keycode = keys[i].keycode;
+		if (keys[i].level == 1)
+		    key->state = GDK_SHIFT_MASK;
+		break;
+	    }
+	}
+	g_free (keys);
+    }
+}
+
+GArray*
+bench_keys_parse (const gchar *text)
+{
+    GArray *keys;
+    BenchKey key;
+    const gchar *p;
+    guint keyval;
+
+    keys = g_array_new (FALSE, FALSE, sizeof (BenchKey));
+
+    for (p = text; *p != '\0'; p++) {
+	keyval = 0;
+	if (*p == '\\' && p[1] != '\0') {
+	    p++;
+	    switch (*p) {
+	    case 'n':  keyval = GDK_KEY_Return;       break;
+	    case 't':  keyval = GDK_KEY_Tab;          break;
+	    case 'b':  keyval = GDK_KEY_BackSpace;    break;
+	    case 'e':  keyval = GDK_KEY_Escape;       break;
+	    case 'h':  keyval = GDK_KEY_Hangul;       break;
+	    case 'j':  keyval = GDK_KEY_Hangul_Hanja; break;
+	    case '\\': keyval = GDK_KEY_backslash;    break;
+	    default:
+		g_warning ("unknown key escape: \\%c", *p);
+		break;
+	    }
+	} else if (*p >= 0x20 && *p <= 0x7e) {
+	    /* the keyvals of ASCII characters are the same as the codes */
+	    keyval = *p;
+	}
+
+	if (keyval != 0) {
+	    bench_key_from_keyval (&key, keyval);
+	    g_array_append_val (keys, key);
+	}
+    }
+
+    return keys;
+}
+
+GArray*
+bench_keys_load (const gchar *filename, GError **error)
+{
+    gchar *text = NULL;
+    GArray *keys;
+
+    if (!g_file_get_contents (filename, &text, NULL, error))
+	return NULL;
+
+    keys = bench_keys_parse (text);
+    g_free (text);
+
+    return keys;
+}
+
+/* vim: set sw=4 : */
@@ -0,0 +1,235 @@
+/* hanja lookup benchmark
+ *
+ * Loads the hanja table the way popup_candidate_window() does and looks up
+ * the keys the module would make from a text: for every hangul syllable,
+ * the word up to and including it, as if the cursor were right after it.
+ * hanja_table_match_suffix() and the walk over the result list with
+ * hanja_list_get_nth(), which the candidate window does to fill its pages,
+ * are timed separately:
+ *   ./bench-hanja -f news.txt
+ *   ./bench-hanja -f news.txt -t /usr/share/libhangul/hanja/hanja.txt
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <glib.h>
+#include <hangul.h>
+
+#include "bench.h"
+
+/* the same limit as im_hangul_get_candidate_string() */
+#define MAX_KEY_LENGTH 20
+
+/* 한자 변환 성능 측정용 기본 문장 */
+static const gchar default_text[] =
+    "대한민국 헌법 제1조 대한민국은 민주공화국이다. "
+    "대한민국의 주권은 국민에게 있고, 모든 권력은 국민으로부터 나온다. "
+    "학교 도서관 전화 경제 문화 사회 정치 역사 과학 기술";
+
+static gchar   *opt_text_file = NULL;
+static gchar   *opt_table_file = NULL;
+static gint     opt_repeat = 0;
+static gint     opt_min_lookups = 100000;
+
+static const GOptionEntry entries[] = {
+    { "text", 'f', 0, G_OPTION_ARG_FILENAME, &opt_text_file,
+      "UTF-8 text to take the keys from (default: a few sentences)", "FILE" },
+    { "table", 't', 0, G_OPTION_ARG_FILENAME, &opt_table_file,
+      "hanja table file (default: the one of libhangul)", "FILE" },
+    { "repeat", 'n', 0, G_OPTION_ARG_INT, &opt_repeat,
+      "look up the keys N times", "N" },
+    { "min-lookups", 'm', 0, G_OPTION_ARG_INT, &opt_min_lookups,
+      "look up until at least N keys are done, if -n is not given", "N" },
+    { NULL }
+};
+
+static gboolean
+is_hangul_syllable (gunichar c)
+{
+    return c >= 0xac00 && c <= 0xd7a3;
+}
+
+/* the keys of the candidate window: the word before the cursor, for every
+ * cursor position after a hangul syllable */
+static GPtrArray*
+make_keys (const gchar *text)
+{
+    GPtrArray *keys;
+    const gchar *word = NULL;
+    const gchar *p;
+
+    keys = g_ptr_array_new_with_free_func (g_free);
+
+    for (p = text; *p != '\0'; p = g_utf8_next_char (p)) {
+	gunichar c = g_utf8_get_char (p);
+	const gchar *end;
+	const gchar *start;
+
+	if (!is_hangul_syllable (c)) {
+	    word = NULL;
+	    continue;
+	}
+
+	if (word == NULL)
+	    word = p;
+
+	end = g_utf8_next_char (p);
+	start = word;
+	if (g_utf8_pointer_to_offset (start, end) > MAX_KEY_LENGTH)
+	    start = g_utf8_offset_to_pointer (end, -MAX_KEY_LENGTH);
+
+	g_ptr_array_add (keys, g_strndup (start, end - start));
+    }
+
+    return keys;
+}
+
+int
+main (int argc, char *argv[])
+{
+    GOptionContext *option_context;
+    GError *error = NULL;
+    gchar *text = NULL;
+    GPtrArray *keys;
+    HanjaTable *table;
+    GArray *match_samples;
+    GArray *walk_samples;
+    GArray *sizes;
+    glong rss;
+    guint64 start;
+    guint64 load_time;
+    guint64 match_total = 0;
+    guint64 walk_total = 0;
+    guint64 n_misses = 0;
+    gsize sink = 0;
+    guint i;
+    gint n;
+    gint repeat;
+
+    option_context = g_option_context_new ("- look up hanja like imhangul");
+    g_option_context_add_main_entries (option_context, entries, NULL);
+    if (!g_option_context_parse (option_context, &argc, &argv, &error)) {
+	g_printerr ("%s\n", error->message);
+	return 1;
+    }
+    g_option_context_free (option_context);
+
+    if (opt_text_file != NULL) {
+	if (!g_file_get_contents (opt_text_file, &text, NULL, &error)) {
+	    g_printerr ("%s\n", error->message);
+	    return 1;
+	}
+	if (!g_utf8_validate (text, -1, NULL)) {
+	    g_printerr ("%s: not UTF-8 text\n", opt_text_file);
+	    return 1;
+	}
+    } else {
+	text = g_strdup (default_text);
+    }
+
+    keys = make_keys (text);
+    g_free (text);
+
+    if (keys->len == 0) {
+	g_printerr ("no hangul in the text\n");
+	return 1;
+    }
+
+    repeat = opt_repeat;
+    if (repeat <= 0)
+	repeat = (opt_min_lookups + keys->len - 1) / keys->len;
+
+    rss = bench_rss_kb ();
+    start = bench_now_ns ();
+    table = hanja_table_load (opt_table_file);
+    load_time = bench_now_ns () - start;
+    if (table == NULL) {
+	g_printerr ("can't load the hanja table\n");
+	return 1;
+    }
+    rss = bench_rss_kb () - rss;
+
+    match_samples = bench_samples_new (keys->len * repeat);
+    walk_samples = bench_samples_new (keys->len * repeat);
+    sizes = bench_samples_new (keys->len);
+
+    for (n = 0; n < repeat; n++) {
+	for (i = 0; i < keys->len; i++) {
+	    const gchar *key = g_ptr_array_index (keys, i);
+	    HanjaList *list;
+	    guint64 elapsed;
+	    guint64 size = 0;
+	    int j;
+
+	    start = bench_now_ns ();
+	    list = hanja_table_match_suffix (table, key);
+	    elapsed = bench_now_ns () - start;
+	    match_total += elapsed;
+	    g_array_append_val (match_samples, elapsed);
+
+	    if (list == NULL) {
+		if (n == 0) {
+		    n_misses++;
+		    g_array_append_val (sizes, size);
+		}
+		continue;
+	    }
+
+	    /* what candidate_new() and the page updates read, then free */
+	    start = bench_now_ns ();
+	    size = hanja_list_get_size (list);
+	    for (j = 0; j < size; j++) {
+		const Hanja *hanja = hanja_list_get_nth (list, j);
+
+		sink += strlen (hanja_get_value (hanja));
+		sink += strlen (hanja_get_comment (hanja));
+	    }
+	    hanja_list_delete (list);
+	    elapsed = bench_now_ns () - start;
+	    walk_total += elapsed;
+	    g_array_append_val (walk_samples, elapsed);
+
+	    if (n == 0)
+		g_array_append_val (sizes, size);
+	}
+    }
+
+    bench_samples_sort (sizes);
+
+    printf ("keys                %u x %d\n", keys->len, repeat);
+    printf ("load                %.3f ms\n", load_time / 1e6);
+    printf ("rss delta           %ld kB\n", rss);
+    printf ("lookups/sec         %.0f\n",
+	    match_samples->len / (match_total / 1e9));
+    printf ("lookups+walk/sec    %.0f\n",
+	    match_samples->len / ((match_total + walk_total) / 1e9));
+    printf ("misses              %" G_GUINT64_FORMAT " of %u\n",
+	    n_misses, keys->len);
+    printf ("list size           p50 %" G_GUINT64_FORMAT
+	    " p99 %" G_GUINT64_FORMAT " max %" G_GUINT64_FORMAT "\n",
+	    bench_samples_percentile (sizes, 50.0),
+	    bench_samples_percentile (sizes, 99.0),
+	    bench_samples_percentile (sizes, 100.0));
+    bench_samples_print ("match_suffix", match_samples);
+    bench_samples_print ("list walk", walk_samples);
+
+    /* keep the walk from being optimized away */
+    if (sink == 0)
+	printf ("all lists were empty\n");
+
+    g_array_free (sizes, TRUE);
+    g_array_free (walk_samples, TRUE);
+    g_array_free (match_samples, TRUE);
+    g_ptr_array_free (keys, TRUE);
+    hanja_table_delete (table);
+
+    return 0;
+}
+
+/* vim: set sw=4 : */
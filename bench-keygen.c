@@ -0,0 +1,721 @@
+/* key stream generator for the imhangul benchmark programs
+ *
+ * Turns Korean UTF-8 text into the keys which type it on a hangul keyboard,
+ * in the key stream format bench-keypress reads (see bench-client.c):
+ *   ./bench-keygen -k 39 news.txt > news.39.keys
+ *   ./bench-keygen -a -o news news.txt      (writes news.<id>.keys)
+ *
+ * The keys of each jamo are not hardcoded here. They are found by typing
+ * every key and every pair of keys into a libhangul input context in jamo
+ * output mode, so every keyboard libhangul knows is supported, with its own
+ * combination rules. The generated stream is replayed through libhangul
+ * at the end and the result is compared with the text.
+ *
+ * Latin text is typed in direct mode, switching with the hangul key (\h),
+ * when its keys would compose hangul on the keyboard. Characters which
+ * cannot be typed, like hanja or most symbols, are dropped and counted.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <string.h>
+
+#include <glib.h>
+#include <gdk/gdkkeysyms.h>
+#include <hangul.h>
+
+#include "imhangul-keymap.h"
+
+#define KEY_FIRST   0x21
+#define KEY_LAST    0x7e
+
+#define CHOSEONG_FILLER   0x115f
+#define JUNGSEONG_FILLER  0x1160
+
+typedef struct _Keygen Keygen;
+struct _Keygen {
+    const char *id;
+    HangulInputContext *hic;
+
+    /* conjoining jamo -> keys */
+    GHashTable *choseong;
+    GHashTable *jungseong;
+    GHashTable *jongseong;
+
+    /* printable ASCII keys which do not type themselves in hangul mode */
+    gboolean direct_only[128];
+
+    /* character -> keys, "" if the character cannot be typed */
+    GHashTable *cache;
+};
+
+typedef struct _KeygenStat KeygenStat;
+struct _KeygenStat {
+    guint n_chars;
+    guint n_keys;
+    guint n_dropped;
+    guint n_flushes;
+    glong mismatch;	/* offset of the first difference, -1 if none */
+};
+
+static gchar   *opt_keyboard = NULL;
+static gboolean opt_all = FALSE;
+static gchar   *opt_output = NULL;
+static gchar   *opt_layout = NULL;
+static gboolean opt_dvorak = FALSE;
+
+static guint    latin_layout = IM_HANGUL_LATIN_LAYOUT_QWERTY;
+
+static const GOptionEntry entries[] = {
+    { "keyboard", 'k', 0, G_OPTION_ARG_STRING, &opt_keyboard,
+      "libhangul keyboard id (default: 2)", "ID" },
+    { "all", 'a', 0, G_OPTION_ARG_NONE, &opt_all,
+      "generate a stream for every keyboard, into PREFIX.ID.keys", NULL },
+    { "output", 'o', 0, G_OPTION_ARG_FILENAME, &opt_output,
+      "output file, or the prefix of the files with -a", "FILE" },
+    { "layout", 'l', 0, G_OPTION_ARG_STRING, &opt_layout,
+      "type the keys on a latin layout (for latin_layout)", "NAME" },
+    { "dvorak", 'd', 0, G_OPTION_ARG_NONE, &opt_dvorak,
+      "same as --layout=dvorak (for enable_dvorak)", NULL },
+    { NULL }
+};
+
+/* the key of the layout at the position of the qwerty key c */
+static gchar
+keygen_qwerty_to_layout (gchar c)
+{
+    if (c < IM_HANGUL_LATIN_LAYOUT_FIRST ||
+	c >= IM_HANGUL_LATIN_LAYOUT_FIRST + IM_HANGUL_LATIN_LAYOUT_LENGTH)
+	return c;
+    return im_hangul_latin_layout_from_qwerty[latin_layout]
+		[c - IM_HANGUL_LATIN_LAYOUT_FIRST];
+}
+
+/* the qwerty key at the position of the key c of the layout, what the
+ * module gives to libhangul in hangul mode */
+static gchar
+keygen_layout_to_qwerty (gchar c)
+{
+    if (c < IM_HANGUL_LATIN_LAYOUT_FIRST ||
+	c >= IM_HANGUL_LATIN_LAYOUT_FIRST + IM_HANGUL_LATIN_LAYOUT_LENGTH)
+	return c;
+    return im_hangul_latin_layout_to_qwerty[latin_layout]
+		[c - IM_HANGUL_LATIN_LAYOUT_FIRST];
+}
+
+/* Types context and then keys from an empty state, and splits the jamo
+ * preedit string into its choseong, jungseong and jongseong. */
+static gboolean
+keygen_probe (Keygen *keygen, const char *context, const char *keys,
+	      ucschar jamo[3])
+{
+    const char *p;
+    const ucschar *str;
+
+    hangul_ic_reset (keygen->hic);
+
+    for (p = context; *p != '\0'; p++) {
+	if (!hangul_ic_process (keygen->hic, *p))
+	    return FALSE;
+    }
+    for (p = keys; *p != '\0'; p++) {
+	if (!hangul_ic_process (keygen->hic, *p))
+	    return FALSE;
+    }
+
+    str = hangul_ic_get_commit_string (keygen->hic);
+    if (str[0] != 0)
+	return FALSE;
+
+    jamo[0] = jamo[1] = jamo[2] = 0;
+    str = hangul_ic_get_preedit_string (keygen->hic);
+    for (; *str != 0; str++) {
+	if (*str == CHOSEONG_FILLER || *str == JUNGSEONG_FILLER)
+	    continue;
+	else if (hangul_is_choseong (*str) && jamo[0] == 0)
+	    jamo[0] = *str;
+	else if (hangul_is_jungseong (*str) && jamo[1] == 0)
+	    jamo[1] = *str;
+	else if (hangul_is_jongseong (*str) && jamo[2] == 0)
+	    jamo[2] = *str;
+	else
+	    return FALSE;
+    }
+
+    return TRUE;
+}
+
+static void
+keygen_learn_keys (Keygen *keygen, const char *keys,
+		   const char *cho_context, ucschar cho,
+		   const char *jung_context, ucschar jung)
+{
+    ucschar jamo[3];
+
+    if (keygen_probe (keygen, "", keys, jamo) &&
+	jamo[0] != 0 && jamo[1] == 0 && jamo[2] == 0 &&
+	g_hash_table_lookup (keygen->choseong, GUINT_TO_POINTER (jamo[0])) == NULL) {
+	g_hash_table_insert (keygen->choseong,
+			     GUINT_TO_POINTER (jamo[0]), g_strdup (keys));
+    }
+
+    if (cho_context == NULL)
+	return;
+
+    if (keygen_probe (keygen, cho_context, keys, jamo) &&
+	jamo[0] == cho && jamo[1] != 0 && jamo[2] == 0 &&
+	g_hash_table_lookup (keygen->jungseong, GUINT_TO_POINTER (jamo[1])) == NULL) {
+	g_hash_table_insert (keygen->jungseong,
+			     GUINT_TO_POINTER (jamo[1]), g_strdup (keys));
+    }
+
+    if (jung_context == NULL)
+	return;
+
+    if (keygen_probe (keygen, jung_context, keys, jamo) &&
+	jamo[0] == cho && jamo[1] == jung && jamo[2] != 0 &&
+	g_hash_table_lookup (keygen->jongseong, GUINT_TO_POINTER (jamo[2])) == NULL) {
+	g_hash_table_insert (keygen->jongseong,
+			     GUINT_TO_POINTER (jamo[2]), g_strdup (keys));
+    }
+}
+
+static void
+keygen_learn (Keygen *keygen)
+{
+    char keys[3] = { 0, };
+    char *cho_context = NULL;
+    char *jung_context = NULL;
+    ucschar cho = 0;
+    ucschar jung = 0;
+    const char *str;
+    int pass;
+    int i, j;
+
+    hangul_ic_set_output_mode (keygen->hic, HANGUL_OUTPUT_SYLLABLE);
+
+    /* latin text can be typed in hangul mode only with the keys
+     * which commit themselves, at their position on the qwerty layout */
+    for (i = KEY_FIRST; i <= KEY_LAST; i++) {
+	const ucschar *commit;
+
+	hangul_ic_reset (keygen->hic);
+	if (hangul_ic_process (keygen->hic, keygen_layout_to_qwerty (i))) {
+	    commit = hangul_ic_get_commit_string (keygen->hic);
+	    if (commit[0] != (ucschar)i || commit[1] != 0 ||
+		!hangul_ic_is_empty (keygen->hic))
+		keygen->direct_only[i] = TRUE;
+	}
+    }
+
+    hangul_ic_set_output_mode (keygen->hic, HANGUL_OUTPUT_JAMO);
+
+    /* single keys: the choseong from an empty state, the jungseong after
+     * a choseong, IEUNG if the keyboard has it, and the jongseong after
+     * the choseong and a jungseong, A if the keyboard has it */
+    for (pass = 0; pass < 3; pass++) {
+	if (pass == 1) {
+	    str = g_hash_table_lookup (keygen->choseong,
+				       GUINT_TO_POINTER (0x110b));
+	    if (str == NULL)
+		break;
+	    cho = 0x110b;
+	    cho_context = g_strdup (str);
+	} else if (pass == 2) {
+	    str = g_hash_table_lookup (keygen->jungseong,
+				       GUINT_TO_POINTER (0x1161));
+	    if (str == NULL)
+		break;
+	    jung = 0x1161;
+	    jung_context = g_strconcat (cho_context, str, NULL);
+	}
+
+	for (i = KEY_FIRST; i <= KEY_LAST; i++) {
+	    keys[0] = i;
+	    keygen_learn_keys (keygen, keys,
+			       cho_context, cho, jung_context, jung);
+	}
+    }
+
+    /* pairs of keys, for the jamo which need two keys */
+    for (i = KEY_FIRST; i <= KEY_LAST; i++) {
+	for (j = KEY_FIRST; j <= KEY_LAST; j++) {
+	    keys[0] = i;
+	    keys[1] = j;
+	    keygen_learn_keys (keygen, keys,
+			       cho_context, cho, jung_context, jung);
+	}
+    }
+
+    g_free (cho_context);
+    g_free (jung_context);
+
+    hangul_ic_reset (keygen->hic);
+    hangul_ic_set_output_mode (keygen->hic, HANGUL_OUTPUT_SYLLABLE);
+}
+
+static Keygen*
+keygen_new (const char *id)
+{
+    Keygen *keygen;
+
+    keygen = g_new0 (Keygen, 1);
+    keygen->id = id;
+    keygen->hic = hangul_ic_new (id);
+    keygen->choseong = g_hash_table_new_full (g_direct_hash, g_direct_equal,
+					      NULL, g_free);
+    keygen->jungseong = g_hash_table_new_full (g_direct_hash, g_direct_equal,
+					       NULL, g_free);
+    keygen->jongseong = g_hash_table_new_full (g_direct_hash, g_direct_equal,
+					       NULL, g_free);
+    keygen->cache = g_hash_table_new_full (g_direct_hash, g_direct_equal,
+					   NULL, g_free);
+
+    keygen_learn (keygen);
+
+    return keygen;
+}
+
+static void
+keygen_delete (Keygen *keygen)
+{
+    g_hash_table_destroy (keygen->choseong);
+    g_hash_table_destroy (keygen->jungseong);
+    g_hash_table_destroy (keygen->jongseong);
+    g_hash_table_destroy (keygen->cache);
+    hangul_ic_delete (keygen->hic);
+    g_free (keygen);
+}
+
+static void
+keygen_append_ucs (GString *str, const ucschar *ucs)
+{
+    for (; *ucs != 0; ucs++)
+	g_string_append_unichar (str, *ucs);
+}
+
+/* Replays a key stream the way the im module handles it and returns
+ * the text the client would receive. With layout the keys are typed on
+ * the latin layout, otherwise they are qwerty keys. */
+static gchar*
+keygen_simulate (Keygen *keygen, const char *keys, gboolean layout)
+{
+    GString *out;
+    gboolean hangul_mode = TRUE;
+    const char *p;
+    gchar *text;
+
+    out = g_string_new (NULL);
+    hangul_ic_reset (keygen->hic);
+
+    for (p = keys; *p != '\0'; p++) {
+	char c = *p;
+
+	if (c == '\\' && p[1] != '\0') {
+	    p++;
+	    switch (*p) {
+	    case 'h':
+		keygen_append_ucs (out, hangul_ic_flush (keygen->hic));
+		hangul_mode = !hangul_mode;
+		continue;
+	    case 'n':
+		keygen_append_ucs (out, hangul_ic_flush (keygen->hic));
+		g_string_append_c (out, '\n');
+		continue;
+	    case 't':
+		keygen_append_ucs (out, hangul_ic_flush (keygen->hic));
+		g_string_append_c (out, '\t');
+		continue;
+	    case '\\':
+		c = '\\';
+		break;
+	    default:
+		continue;
+	    }
+	}
+
+	if (hangul_mode && c != ' ' &&
+	    hangul_ic_process (keygen->hic,
+			       layout ? keygen_layout_to_qwerty (c) : c)) {
+	    keygen_append_ucs (out, hangul_ic_get_commit_string (keygen->hic));
+	} else {
+	    if (hangul_mode)
+		keygen_append_ucs (out, hangul_ic_flush (keygen->hic));
+	    g_string_append_c (out, c);
+	}
+    }
+    keygen_append_ucs (out, hangul_ic_flush (keygen->hic));
+
+    text = g_utf8_normalize (out->str, -1, G_NORMALIZE_NFC);
+    g_string_free (out, TRUE);
+
+    return text;
+}
+
+static const char*
+keygen_lookup_jamo (Keygen *keygen, GHashTable *table, ucschar cjamo)
+{
+    GHashTableIter iter;
+    gpointer key;
+    gpointer value;
+
+    g_hash_table_iter_init (&iter, table);
+    while (g_hash_table_iter_next (&iter, &key, &value)) {
+	if (hangul_jamo_to_cjamo (GPOINTER_TO_UINT (key)) == cjamo)
+	    return value;
+    }
+
+    return NULL;
+}
+
+/* Returns the keys of a hangul syllable or compatibility jamo, typed
+ * from an empty state, or "" if the keyboard cannot type it alone. */
+static const char*
+keygen_get_keys (Keygen *keygen, gunichar c)
+{
+    const char *cached;
+    const char *candidates[3] = { NULL, NULL, NULL };
+    gchar *keys = NULL;
+    int i;
+
+    cached = g_hash_table_lookup (keygen->cache, GUINT_TO_POINTER (c));
+    if (cached != NULL)
+	return cached;
+
+    if (hangul_is_syllable (c)) {
+	ucschar cho, jung, jong;
+	const char *cho_keys;
+	const char *jung_keys;
+	const char *jong_keys = "";
+
+	hangul_syllable_to_jamo (c, &cho, &jung, &jong);
+	cho_keys = g_hash_table_lookup (keygen->choseong,
+					GUINT_TO_POINTER (cho));
+	jung_keys = g_hash_table_lookup (keygen->jungseong,
+					 GUINT_TO_POINTER (jung));
+	if (jong != 0)
+	    jong_keys = g_hash_table_lookup (keygen->jongseong,
+					     GUINT_TO_POINTER (jong));
+	if (cho_keys != NULL && jung_keys != NULL && jong_keys != NULL)
+	    keys = g_strconcat (cho_keys, jung_keys, jong_keys, NULL);
+    } else if (hangul_is_cjamo (c)) {
+	candidates[0] = keygen_lookup_jamo (keygen, keygen->choseong, c);
+	candidates[1] = keygen_lookup_jamo (keygen, keygen->jungseong, c);
+	candidates[2] = keygen_lookup_jamo (keygen, keygen->jongseong, c);
+    }
+
+    /* keep only the keys which really type the character */
+    for (i = -1; i < (int)G_N_ELEMENTS (candidates); i++) {
+	gchar *text;
+	gchar expected[8];
+
+	if (i >= 0) {
+	    if (keys != NULL || candidates[i] == NULL)
+		continue;
+	    keys = g_strdup (candidates[i]);
+	}
+	if (keys == NULL)
+	    continue;
+
+	expected[g_unichar_to_utf8 (c, expected)] = '\0';
+	text = keygen_simulate (keygen, keys, FALSE);
+	if (strcmp (text, expected) != 0) {
+	    g_free (keys);
+	    keys = NULL;
+	}
+	g_free (text);
+    }
+
+    if (keys == NULL)
+	keys = g_strdup ("");
+
+    g_hash_table_insert (keygen->cache, GUINT_TO_POINTER (c), keys);
+
+    return keys;
+}
+
+/* Returns TRUE if prev_keys followed by keys still types both characters,
+ * that is, if the keys of c do not change the previous syllable. */
+static gboolean
+keygen_check_boundary (Keygen *keygen, GString *prev_keys, gunichar prev,
+		       const char *keys, gunichar c)
+{
+    gchar expected[16];
+    gchar *stream;
+    gchar *text;
+    gboolean res;
+    int n;
+
+    n = g_unichar_to_utf8 (prev, expected);
+    n += g_unichar_to_utf8 (c, expected + n);
+    expected[n] = '\0';
+
+    stream = g_strconcat (prev_keys->str, keys, NULL);
+    text = keygen_simulate (keygen, stream, FALSE);
+    res = strcmp (text, expected) == 0;
+    g_free (text);
+    g_free (stream);
+
+    return res;
+}
+
+/* Appends the qwerty keys of a jamo as they are typed on the latin layout.
+ * Only the jamo keys are moved, the module gives the other keys to the
+ * client as they are. */
+static void
+keygen_append_layout_keys (GString *out, const char *keys)
+{
+    for (; *keys != '\0'; keys++) {
+	gchar c = keygen_qwerty_to_layout (*keys);
+
+	if (c == '\\')
+	    g_string_append (out, "\\\\");
+	else
+	    g_string_append_c (out, c);
+    }
+}
+
+static gchar*
+keygen_generate (Keygen *keygen, const gchar *text, GString *expected,
+		 KeygenStat *stat)
+{
+    GString *out;
+    GString *prev_keys;
+    gunichar prev = 0;
+    gboolean hangul_mode = TRUE;
+    const gchar *p;
+
+    out = g_string_new (NULL);
+    prev_keys = g_string_new (NULL);
+
+    for (p = text; *p != '\0'; p = g_utf8_next_char (p)) {
+	gunichar c = g_utf8_get_char (p);
+	const char *keys;
+
+	if (c == '\n' || c == '\t') {
+	    g_string_append (out, c == '\n' ? "\\n" : "\\t");
+	    g_string_truncate (prev_keys, 0);
+	} else if (c >= 0x20 && c < 0x7f) {
+	    if (hangul_mode && keygen->direct_only[c]) {
+		g_string_append (out, "\\h");
+		hangul_mode = FALSE;
+	    }
+	    if (c == '\\')
+		g_string_append (out, "\\\\");
+	    else
+		g_string_append_c (out, c);
+	    g_string_truncate (prev_keys, 0);
+	} else if (*(keys = keygen_get_keys (keygen, c)) != '\0') {
+	    if (!hangul_mode) {
+		g_string_append (out, "\\h");
+		hangul_mode = TRUE;
+	    } else if (prev_keys->len > 0 &&
+		       !keygen_check_boundary (keygen, prev_keys, prev, keys, c)) {
+		/* commit the previous syllable first */
+		g_string_append (out, "\\h\\h");
+		stat->n_flushes++;
+	    }
+	    keygen_append_layout_keys (out, keys);
+	    g_string_assign (prev_keys, keys);
+	    prev = c;
+	} else {
+	    stat->n_dropped++;
+	    continue;
+	}
+
+	g_string_append_unichar (expected, c);
+	stat->n_chars++;
+    }
+
+    g_string_free (prev_keys, TRUE);
+
+    return g_string_free (out, FALSE);
+}
+
+static guint
+keygen_count_keys (const gchar *keys)
+{
+    guint n = 0;
+
+    for (; *keys != '\0'; keys++) {
+	if (*keys == '\\' && keys[1] != '\0')
+	    keys++;
+	n++;
+    }
+
+    return n;
+}
+
+static gboolean
+keygen_write (const gchar *keys, const gchar *filename)
+{
+    FILE *file;
+    const gchar *p;
+    int column = 0;
+
+    if (filename == NULL) {
+	file = stdout;
+    } else {
+	file = fopen (filename, "w");
+	if (file == NULL) {
+	    g_printerr ("%s: cannot open\n", filename);
+	    return FALSE;
+	}
+    }
+
+    /* line breaks are ignored by the reader, only keep escapes in one piece */
+    for (p = keys; *p != '\0'; p++) {
+	if (*p == '\\' && p[1] != '\0') {
+	    fputc (*p, file);
+	    p++;
+	    fputc (*p, file);
+	    column += 2;
+	} else {
+	    fputc (*p, file);
+	    column++;
+	}
+
+	if (column >= 76) {
+	    fputc ('\n', file);
+	    column = 0;
+	}
+    }
+    fputc ('\n', file);
+
+    if (file != stdout)
+	fclose (file);
+
+    return TRUE;
+}
+
+static gboolean
+keygen_run (const char *id, const gchar *text, const gchar *filename)
+{
+    Keygen *keygen;
+    KeygenStat stat = { 0, 0, 0, 0, -1 };
+    GString *expected;
+    gchar *keys;
+    gchar *typed;
+    gboolean res;
+
+    keygen = keygen_new (id);
+
+    expected = g_string_new (NULL);
+    keys = keygen_generate (keygen, text, expected, &stat);
+    stat.n_keys = keygen_count_keys (keys);
+
+    typed = keygen_simulate (keygen, keys, TRUE);
+    if (strcmp (typed, expected->str) != 0) {
+	const gchar *a = typed;
+	const gchar *b = expected->str;
+
+	while (*a != '\0' && *a == *b) {
+	    a++;
+	    b++;
+	}
+	stat.mismatch = g_utf8_pointer_to_offset (expected->str, b);
+    }
+
+    g_printerr ("%-4s chars %-8u keys %-8u keys/char %.2f  "
+		"dropped %-6u flushes %-6u %s",
+		id, stat.n_chars, stat.n_keys,
+		stat.n_chars > 0 ? (double)stat.n_keys / stat.n_chars : 0.0,
+		stat.n_dropped, stat.n_flushes,
+		stat.mismatch < 0 ? "verified\n" : "MISMATCH at char ");
+    if (stat.mismatch >= 0)
+	g_printerr ("%ld\n", stat.mismatch);
+
+    res = keygen_write (keys, filename);
+
+    g_free (typed);
+    g_free (keys);
+    g_string_free (expected, TRUE);
+    keygen_delete (keygen);
+
+    return res;
+}
+
+int
+main (int argc, char *argv[])
+{
+    GOptionContext *option_context;
+    GError *error = NULL;
+    GString *corpus;
+    gchar *text;
+    gboolean res = TRUE;
+    int i;
+
+    option_context = g_option_context_new ("FILE... - make key streams from text");
+    g_option_context_add_main_entries (option_context, entries, NULL);
+    if (!g_option_context_parse (option_context, &argc, &argv, &error)) {
+	g_printerr ("%s\n", error->message);
+	return 1;
+    }
+    g_option_context_free (option_context);
+
+    if (opt_dvorak)
+	latin_layout = IM_HANGUL_LATIN_LAYOUT_DVORAK;
+    if (opt_layout != NULL) {
+	for (i = 0; i < IM_HANGUL_LATIN_LAYOUT_LAST; i++) {
+	    if (g_ascii_strcasecmp (opt_layout,
+				    im_hangul_latin_layout_names[i]) == 0)
+		break;
+	}
+	if (i == IM_HANGUL_LATIN_LAYOUT_LAST) {
+	    g_printerr ("unknown layout: %s\n", opt_layout);
+	    return 1;
+	}
+	latin_layout = i;
+    }
+
+    if (argc < 2) {
+	g_printerr ("no input files\n");
+	return 1;
+    }
+
+    corpus = g_string_new (NULL);
+    for (i = 1; i < argc; i++) {
+	gchar *contents = NULL;
+
+	if (!g_file_get_contents (argv[i], &contents, NULL, &error)) {
+	    g_printerr ("%s\n", error->message);
+	    return 1;
+	}
+	if (!g_utf8_validate (contents, -1, NULL)) {
+	    g_printerr ("%s: not UTF-8 text\n", argv[i]);
+	    return 1;
+	}
+	g_string_append (corpus, contents);
+	g_free (contents);
+    }
+
+    /* jamo sequences become syllables, so they can be typed */
+    text = g_utf8_normalize (corpus->str, -1, G_NORMALIZE_NFC);
+    g_string_free (corpus, TRUE);
+
+    if (opt_all) {
+	const gchar *prefix = opt_output != NULL ? opt_output : "corpus";
+	unsigned n = hangul_ic_get_n_keyboards ();
+	unsigned k;
+
+	for (k = 0; k < n; k++) {
+	    const char *id = hangul_ic_get_keyboard_id (k);
+	    gchar *filename = g_strdup_printf ("%s.%s.keys", prefix, id);
+
+	    res = keygen_run (id, text, filename) && res;
+	    g_free (filename);
+	}
+    } else {
+	res = keygen_run (opt_keyboard != NULL ? opt_keyboard : "2",
+			  text, opt_output);
+    }
+
+    g_free (text);
+
+    return res ? 0 : 1;
+}
+
+/* vim: set sw=4 : */
@@ -0,0 +1,183 @@
+/* keystroke replay benchmark for the hangul input context
+ *
+ * Feeds a key stream to a GtkIMContextHangul bound to a client widget which
+ * is never shown, and reports the throughput and the latency distribution
+ * of im_hangul_ic_filter_keypress(), including the preedit and commit
+ * signals and the preedit string queries of the client.
+ *
+ * Key stream files can be made from Korean text with bench-keygen.
+ *
+ * With --alloc-budget it also counts the heap allocations of the key
+ * processing, and fails if there are more per key than the budget, so
+ * the allocation free typing path stays that way:
+ *   ./bench-keypress -k 2 --alloc-budget=0
+ *
+ * It needs a display, but no window appears on it:
+ *   ./bench-keypress -k 2 -f news.2.keys
+ *   xvfb-run ./bench-keypress -k 39 -f chat.39.keys -n 10
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <gtk/gtk.h>
+
+#include "gtkimcontexthangul.h"
+#include "bench.h"
+
+/* 안녕하세요. 한글 입력기 성능 측정 (hangul dubeolsik) */
+static const gchar default_keys[] =
+    "dkssudgktpdy. gksrmf dlqfurrl tjdsmd cmrwjd\\n";
+
+static gchar   *opt_keyboard = "2";
+static gchar   *opt_keys_file = NULL;
+static gint     opt_repeat = 0;
+static gint     opt_min_keys = 200000;
+static gint     opt_warmup = 1000;
+static gdouble  opt_alloc_budget = -1.0;
+
+static const GOptionEntry entries[] = {
+    { "keyboard", 'k', 0, G_OPTION_ARG_STRING, &opt_keyboard,
+      "libhangul keyboard id (default: 2)", "ID" },
+    { "keys", 'f', 0, G_OPTION_ARG_FILENAME, &opt_keys_file,
+      "key stream file (default: a short dubeolsik sentence)", "FILE" },
+    { "repeat", 'n', 0, G_OPTION_ARG_INT, &opt_repeat,
+      "replay the key stream N times", "N" },
+    { "min-keys", 'm', 0, G_OPTION_ARG_INT, &opt_min_keys,
+      "replay until at least N keys are sent, if -n is not given", "N" },
+    { "warmup", 'w', 0, G_OPTION_ARG_INT, &opt_warmup,
+      "number of keys sent before measuring", "N" },
+    { "alloc-budget", 'a', 0, G_OPTION_ARG_DOUBLE, &opt_alloc_budget,
+      "fail if the key processing allocates more than N times per key", "N" },
+    { NULL }
+};
+
+int
+main (int argc, char *argv[])
+{
+    GOptionContext *option_context;
+    GError *error = NULL;
+    GTypeModule *module;
+    BenchClient *client;
+    GArray *keys;
+    GArray *samples;
+    guint64 start;
+    guint64 end;
+    guint64 total;
+    guint64 n_allocs = 0;
+    gboolean count_allocs;
+    gboolean res = TRUE;
+    guint i;
+    gint n;
+    gint repeat;
+
+    gtk_init (&argc, &argv);
+
+    option_context = g_option_context_new ("- replay keystrokes to imhangul");
+    g_option_context_add_main_entries (option_context, entries, NULL);
+    if (!g_option_context_parse (option_context, &argc, &argv, &error)) {
+	g_printerr ("%s\n", error->message);
+	return 1;
+    }
+    g_option_context_free (option_context);
+
+    count_allocs = opt_alloc_budget >= 0.0;
+#ifndef BENCH_HAVE_ALLOC_COUNT
+    if (count_allocs) {
+	g_printerr ("allocation counting is not supported on this system\n");
+	return 1;
+    }
+#endif
+
+    module = bench_module_load ();
+
+    if (opt_keys_file != NULL) {
+	keys = bench_keys_load (opt_keys_file, &error);
+	if (keys == NULL) {
+	    g_printerr ("%s\n", error->message);
+	    return 1;
+	}
+    } else {
+	keys = bench_keys_parse (default_keys);
+    }
+
+    if (keys->len == 0) {
+	g_printerr ("no keys to replay\n");
+	return 1;
+    }
+
+    repeat = opt_repeat;
+    if (repeat <= 0)
+	repeat = (opt_min_keys + keys->len - 1) / keys->len;
+
+    client = bench_client_new (opt_keyboard);
+
+    for (n = 0; n < opt_warmup; n++) {
+	bench_client_press (client,
+			    &g_array_index (keys, BenchKey, n % keys->len));
+    }
+    gtk_im_context_reset (client->context);
+
+    client->n_commits = 0;
+    client->n_commit_bytes = 0;
+    client->n_preedit_changed = 0;
+    client->n_query_allocs = 0;
+
+    samples = bench_samples_new (keys->len * repeat);
+
+    total = 0;
+    for (n = 0; n < repeat; n++) {
+	for (i = 0; i < keys->len; i++) {
+	    const BenchKey *key = &g_array_index (keys, BenchKey, i);
+	    guint64 elapsed;
+
+	    if (count_allocs)
+		bench_alloc_count_into (&n_allocs);
+	    start = bench_now_ns ();
+	    bench_client_press (client, key);
+	    end = bench_now_ns ();
+	    if (count_allocs)
+		bench_alloc_count_into (NULL);
+
+	    elapsed = end - start;
+	    total += elapsed;
+	    g_array_append_val (samples, elapsed);
+	}
+	gtk_im_context_reset (client->context);
+    }
+
+    printf ("keyboard            %s\n", opt_keyboard);
+    printf ("keys                %u x %d\n", keys->len, repeat);
+    printf ("time                %.3f s\n", total / 1e9);
+    printf ("keys/sec            %.0f\n", samples->len / (total / 1e9));
+    printf ("commits             %" G_GUINT64_FORMAT
+	    " (%" G_GUINT64_FORMAT " bytes)\n",
+	    client->n_commits, client->n_commit_bytes);
+    printf ("preedit changes     %" G_GUINT64_FORMAT "\n",
+	    client->n_preedit_changed);
+    if (count_allocs) {
+	gdouble per_key = (gdouble)n_allocs / samples->len;
+
+	printf ("allocations         %.3f/key (preedit query %.3f/key)\n",
+		per_key, (gdouble)client->n_query_allocs / samples->len);
+	if (per_key > opt_alloc_budget) {
+	    g_printerr ("allocation budget exceeded: %.3f/key > %.3f/key\n",
+			per_key, opt_alloc_budget);
+	    res = FALSE;
+	}
+    }
+    bench_samples_print ("filter_keypress", samples);
+
+    g_array_free (samples, TRUE);
+    g_array_free (keys, TRUE);
+    bench_client_free (client);
+    bench_module_unload (module);
+
+    return res ? 0 : 1;
+}
+
+/* vim: set sw=4 : */
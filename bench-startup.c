@@ -0,0 +1,294 @@
+/* im module startup cost benchmark
+ *
+ * Measures what loading im-hangul.so costs a GTK+ process: opening the
+ * shared object, im_module_init (type registration, config file parsing,
+ * key table setup, key-press-event hook), im_module_list, the first
+ * im_module_create and the first hanja key press, which loads the hanja
+ * table. Every run is a fresh process, started from this program, so
+ * nothing is cached in it.
+ *
+ * The module is loaded like GTK+ loads it, from the built shared object,
+ * and reads the user's ~/.imhangul.conf, as it would at startup:
+ *   ./bench-startup -n 50
+ *   ./bench-startup -m /usr/lib/gtk-3.0/3.0.0/immodules/im-hangul.so
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <gtk/gtk.h>
+#include <gtk/gtkimmodule.h>
+#include <gdk/gdkkeysyms.h>
+#include <gmodule.h>
+
+#include "bench.h"
+
+typedef void          (*ModuleInitFunc)   (GTypeModule *module);
+typedef void          (*ModuleExitFunc)   (void);
+typedef void          (*ModuleListFunc)   (const GtkIMContextInfo ***contexts,
+					   int *n_contexts);
+typedef GtkIMContext* (*ModuleCreateFunc) (const gchar *context_id);
+typedef gboolean      (*FilterKeypressFunc) (gpointer hcontext,
+					     GdkEventKey *key);
+
+static gchar   *opt_module = ".libs/im-hangul.so";
+static gint     opt_runs = 20;
+static gboolean opt_child = FALSE;
+
+static const GOptionEntry entries[] = {
+    { "module", 'm', 0, G_OPTION_ARG_FILENAME, &opt_module,
+      "the im module to load (default: .libs/im-hangul.so)", "FILE" },
+    { "runs", 'n', 0, G_OPTION_ARG_INT, &opt_runs,
+      "number of processes to measure", "N" },
+    { "child", 0, G_OPTION_FLAG_HIDDEN, G_OPTION_ARG_NONE, &opt_child,
+      NULL, NULL },
+    { NULL }
+};
+
+/* the phases measured in each process */
+enum {
+    PHASE_OPEN,
+    PHASE_INIT,
+    PHASE_LIST,
+    PHASE_CREATE,
+    PHASE_POPUP,
+    PHASE_LAST
+};
+
+static const gchar *phase_names[PHASE_LAST] = {
+    "dlopen",
+    "im_module_init",
+    "im_module_list",
+    "first create",
+    "first hanja popup"
+};
+
+/* GTypeModule for the shared object, like the one of GTK+ */
+typedef struct _StartupModule StartupModule;
+struct _StartupModule {
+    GTypeModule parent;
+    ModuleInitFunc init;
+    ModuleExitFunc exit;
+};
+
+typedef GTypeModuleClass StartupModuleClass;
+
+static gboolean
+startup_module_load (GTypeModule *module)
+{
+    ((StartupModule*)module)->init (module);
+    return TRUE;
+}
+
+static void
+startup_module_unload (GTypeModule *module)
+{
+    ((StartupModule*)module)->exit ();
+}
+
+static void
+startup_module_class_init (StartupModuleClass *klass)
+{
+    klass->load = startup_module_load;
+    klass->unload = startup_module_unload;
+}
+
+static GType
+startup_module_get_type (void)
+{
+    static GType type = 0;
+
+    if (type == 0) {
+	static const GTypeInfo info = {
+	    sizeof (StartupModuleClass),
+	    (GBaseInitFunc) NULL,
+	    (GBaseFinalizeFunc) NULL,
+	    (GClassInitFunc) startup_module_class_init,
+	    NULL,
+	    NULL,
+	    sizeof (StartupModule),
+	    0,
+	    (GInstanceInitFunc) NULL,
+	};
+
+	type = g_type_register_static (G_TYPE_TYPE_MODULE,
+				       "ImHangulStartupModule", &info, 0);
+    }
+
+    return type;
+}
+
+static void
+press (FilterKeypressFunc filter_keypress, GtkIMContext *context,
+       GdkWindow *window, guint keyval)
+{
+    GdkEventKey event;
+
+    /* without a keycode the module uses the keyval as it is */
+    memset (&event, 0, sizeof (event));
+    event.type = GDK_KEY_PRESS;
+    event.window = window;
+    event.keyval = keyval;
+
+    if (!filter_keypress (context, &event))
+	gtk_im_context_filter_keypress (context, &event);
+}
+
+/* one measurement, printed as a line for the parent process */
+static int
+run_child (void)
+{
+    GModule *gmodule;
+    StartupModule *module;
+    ModuleListFunc list;
+    ModuleCreateFunc create;
+    FilterKeypressFunc filter_keypress;
+    const GtkIMContextInfo **contexts;
+    int n_contexts;
+    GtkIMContext *context;
+    GtkWidget *toplevel;
+    GtkWidget *entry;
+    GdkWindow *window;
+    guint64 times[PHASE_LAST];
+    guint64 start;
+    glong rss;
+    int i;
+
+    rss = bench_rss_kb ();
+
+    start = bench_now_ns ();
+    gmodule = g_module_open (opt_module, G_MODULE_BIND_LAZY | G_MODULE_BIND_LOCAL);
+    times[PHASE_OPEN] = bench_now_ns () - start;
+    if (gmodule == NULL) {
+	g_printerr ("%s\n", g_module_error ());
+	return 1;
+    }
+
+    module = g_object_new (startup_module_get_type (), NULL);
+    g_type_module_set_name (G_TYPE_MODULE (module), "im-hangul");
+    if (!g_module_symbol (gmodule, "im_module_init", (gpointer*)&module->init) ||
+	!g_module_symbol (gmodule, "im_module_exit", (gpointer*)&module->exit) ||
+	!g_module_symbol (gmodule, "im_module_list", (gpointer*)&list) ||
+	!g_module_symbol (gmodule, "im_module_create", (gpointer*)&create) ||
+	!g_module_symbol (gmodule, "gtk_im_context_hangul_filter_keypress",
+			  (gpointer*)&filter_keypress)) {
+	g_printerr ("%s\n", g_module_error ());
+	return 1;
+    }
+
+    start = bench_now_ns ();
+    g_type_module_use (G_TYPE_MODULE (module));
+    times[PHASE_INIT] = bench_now_ns () - start;
+
+    start = bench_now_ns ();
+    list (&contexts, &n_contexts);
+    times[PHASE_LIST] = bench_now_ns () - start;
+
+    start = bench_now_ns ();
+    context = create ("hangul2");
+    times[PHASE_CREATE] = bench_now_ns () - start;
+
+    /* type 기 and press the hanja key in a client never shown */
+    toplevel = gtk_offscreen_window_new ();
+    entry = gtk_entry_new ();
+    gtk_container_add (GTK_CONTAINER (toplevel), entry);
+    gtk_widget_show_all (toplevel);
+    window = gtk_widget_get_window (entry);
+    gtk_im_context_set_client_window (context, window);
+    gtk_im_context_focus_in (context);
+
+    press (filter_keypress, context, window, GDK_KEY_Hangul);
+    press (filter_keypress, context, window, GDK_KEY_r);
+    press (filter_keypress, context, window, GDK_KEY_l);
+
+    start = bench_now_ns ();
+    press (filter_keypress, context, window, GDK_KEY_Hangul_Hanja);
+    times[PHASE_POPUP] = bench_now_ns () - start;
+
+    press (filter_keypress, context, window, GDK_KEY_Escape);
+
+    rss = bench_rss_kb () - rss;
+
+    for (i = 0; i < PHASE_LAST; i++)
+	printf ("%" G_GUINT64_FORMAT " ", times[i]);
+    printf ("%ld\n", rss);
+
+    /* the process exits here, like a short lived tool */
+    return 0;
+}
+
+int
+main (int argc, char *argv[])
+{
+    GOptionContext *option_context;
+    GError *error = NULL;
+    GArray *samples[PHASE_LAST];
+    glong rss_total = 0;
+    gint run;
+    gint i;
+
+    /* keep GTK+ from loading an installed copy of the module */
+    g_setenv ("GTK_IM_MODULE", "gtk-im-context-simple", TRUE);
+
+    gtk_init (&argc, &argv);
+
+    option_context = g_option_context_new ("- measure the im module startup");
+    g_option_context_add_main_entries (option_context, entries, NULL);
+    if (!g_option_context_parse (option_context, &argc, &argv, &error)) {
+	g_printerr ("%s\n", error->message);
+	return 1;
+    }
+    g_option_context_free (option_context);
+
+    if (opt_child)
+	return run_child ();
+
+    for (i = 0; i < PHASE_LAST; i++)
+	samples[i] = bench_samples_new (opt_runs);
+
+    for (run = 0; run < opt_runs; run++) {
+	gchar *child_argv[] = { argv[0], "--child", "--module", opt_module, NULL };
+	gchar *output = NULL;
+	gint status = 0;
+	guint64 times[PHASE_LAST];
+	glong rss;
+
+	if (!g_spawn_sync (NULL, child_argv, NULL, 0, NULL, NULL,
+			   &output, NULL, &status, &error)) {
+	    g_printerr ("%s\n", error->message);
+	    return 1;
+	}
+
+	if (status != 0 ||
+	    sscanf (output, "%" G_GUINT64_FORMAT " %" G_GUINT64_FORMAT
+		    " %" G_GUINT64_FORMAT " %" G_GUINT64_FORMAT
+		    " %" G_GUINT64_FORMAT " %ld",
+		    &times[PHASE_OPEN], &times[PHASE_INIT], &times[PHASE_LIST],
+		    &times[PHASE_CREATE], &times[PHASE_POPUP], &rss) != 6) {
+	    g_printerr ("the measuring process failed\n");
+	    return 1;
+	}
+	g_free (output);
+
+	for (i = 0; i < PHASE_LAST; i++)
+	    g_array_append_val (samples[i], times[i]);
+	rss_total += rss;
+    }
+
+    printf ("module              %s\n", opt_module);
+    printf ("processes           %d\n", opt_runs);
+    printf ("rss delta           %ld kB (mean)\n", rss_total / opt_runs);
+    for (i = 0; i < PHASE_LAST; i++) {
+	bench_samples_print (phase_names[i], samples[i]);
+	g_array_free (samples[i], TRUE);
+    }
+
+    return 0;
+}
+
+/* vim: set sw=4 : */
@@ -0,0 +1,350 @@
+/* context lifecycle stress test
+ *
+ * Creates many toplevels with many entries, each entry with a hangul
+ * context bound to it like GtkEntry binds its im context: the client window
+ * is set on realize and unset on unrealize. Then runs a long random mix of
+ * operations on them:
+ *   type     a few keys into the focused context
+ *   focus    move the focus to a random entry
+ *   destroy  destroy a random toplevel, often in the middle of a
+ *            composition, and create a new one in its place
+ * and reports the time per operation and the growth of the RSS in the
+ * second half of the run, where the working set should be stable.
+ * The windows are offscreen windows, so nothing appears on the display:
+ *   ./bench-stress -t 500 -e 10 -n 1000000
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <gtk/gtk.h>
+#include <gdk/gdkkeysyms.h>
+
+#include "gtkimcontexthangul.h"
+#include "bench.h"
+
+/* 안녕하세요. 한글 입력기 성능 측정 (hangul dubeolsik) */
+static const gchar default_keys[] =
+    "dkssudgktpdy. gksrmf dlqfurrl tjdsmd cmrwjd\\n";
+
+/* how often each operation is picked, out of 100 */
+#define WEIGHT_TYPE	70
+#define WEIGHT_FOCUS	25
+#define WEIGHT_DESTROY	5
+
+#define MAX_KEYS_PER_TYPE 5
+
+static gint     opt_toplevels = 200;
+static gint     opt_entries = 10;
+static gint     opt_operations = 200000;
+static gint     opt_seed = 0;
+
+static const GOptionEntry entries[] = {
+    { "toplevels", 't', 0, G_OPTION_ARG_INT, &opt_toplevels,
+      "number of toplevel windows (default: 200)", "N" },
+    { "entries", 'e', 0, G_OPTION_ARG_INT, &opt_entries,
+      "number of entries in each toplevel (default: 10)", "N" },
+    { "operations", 'n', 0, G_OPTION_ARG_INT, &opt_operations,
+      "number of random operations (default: 200000)", "N" },
+    { "seed", 's', 0, G_OPTION_ARG_INT, &opt_seed,
+      "random seed (default: 0)", "N" },
+    { NULL }
+};
+
+typedef struct _StressToplevel StressToplevel;
+typedef struct _StressEntry    StressEntry;
+
+struct _StressToplevel {
+    GtkWidget *window;
+    GPtrArray *entries;
+    gboolean hangul_mode;
+};
+
+struct _StressEntry {
+    GtkWidget *widget;
+    GtkIMContext *context;
+    StressToplevel *toplevel;
+};
+
+enum {
+    OP_CREATE,
+    OP_TYPE,
+    OP_FOCUS,
+    OP_DESTROY,
+    OP_LAST
+};
+
+static const gchar *op_names[OP_LAST] = {
+    "create toplevel",
+    "type",
+    "focus",
+    "destroy toplevel"
+};
+
+static GPtrArray   *stress_toplevels;
+static StressEntry *focused = NULL;
+static GArray      *keys;
+static guint        key_pos = 0;
+
+static void
+stress_entry_on_realize (GtkWidget *widget, StressEntry *entry)
+{
+    gtk_im_context_set_client_window (entry->context,
+				      gtk_widget_get_window (widget));
+}
+
+static void
+stress_entry_on_unrealize (GtkWidget *widget, StressEntry *entry)
+{
+    gtk_im_context_set_client_window (entry->context, NULL);
+}
+
+static StressToplevel*
+stress_toplevel_new (void)
+{
+    StressToplevel *toplevel;
+    GtkWidget *box;
+    gint i;
+
+    toplevel = g_new0 (StressToplevel, 1);
+    toplevel->window = gtk_offscreen_window_new ();
+    toplevel->entries = g_ptr_array_new_with_free_func (g_free);
+
+    box = gtk_box_new (GTK_ORIENTATION_VERTICAL, 0);
+    gtk_container_add (GTK_CONTAINER (toplevel->window), box);
+
+    for (i = 0; i < opt_entries; i++) {
+	StressEntry *entry = g_new0 (StressEntry, 1);
+
+	entry->toplevel = toplevel;
+	entry->widget = gtk_entry_new ();
+	entry->context = im_module_create ("hangul2");
+	g_signal_connect (entry->widget, "realize",
+			  G_CALLBACK (stress_entry_on_realize), entry);
+	g_signal_connect (entry->widget, "unrealize",
+			  G_CALLBACK (stress_entry_on_unrealize), entry);
+	gtk_box_pack_start (GTK_BOX (box), entry->widget, FALSE, FALSE, 0);
+	g_ptr_array_add (toplevel->entries, entry);
+    }
+
+    gtk_widget_show_all (toplevel->window);
+
+    return toplevel;
+}
+
+static void
+stress_toplevel_destroy (StressToplevel *toplevel)
+{
+    guint i;
+
+    /* the entries unbind their contexts when they are unrealized,
+     * then the contexts go away with the entries */
+    gtk_widget_destroy (toplevel->window);
+
+    for (i = 0; i < toplevel->entries->len; i++) {
+	StressEntry *entry = g_ptr_array_index (toplevel->entries, i);
+
+	if (entry == focused)
+	    focused = NULL;
+	g_object_unref (entry->context);
+    }
+
+    g_ptr_array_free (toplevel->entries, TRUE);
+    g_free (toplevel);
+}
+
+static StressEntry*
+random_entry (GRand *rand)
+{
+    StressToplevel *toplevel;
+    gint i;
+
+    i = g_rand_int_range (rand, 0, stress_toplevels->len);
+    toplevel = g_ptr_array_index (stress_toplevels, i);
+    i = g_rand_int_range (rand, 0, toplevel->entries->len);
+
+    return g_ptr_array_index (toplevel->entries, i);
+}
+
+static void
+press (StressEntry *entry, const BenchKey *key)
+{
+    bench_context_press (entry->context,
+			 gtk_widget_get_window (entry->widget), key);
+}
+
+static void
+op_focus (GRand *rand)
+{
+    StressEntry *entry = random_entry (rand);
+
+    if (focused != NULL)
+	gtk_im_context_focus_out (focused->context);
+    gtk_im_context_focus_in (entry->context);
+    focused = entry;
+}
+
+static void
+op_type (GRand *rand)
+{
+    gint n;
+
+    if (focused == NULL)
+	op_focus (rand);
+
+    /* every toplevel starts in direct mode */
+    if (!focused->toplevel->hangul_mode) {
+	BenchKey key;
+
+	bench_key_from_keyval (&key, GDK_KEY_Hangul);
+	press (focused, &key);
+	focused->toplevel->hangul_mode = TRUE;
+    }
+
+    for (n = g_rand_int_range (rand, 1, MAX_KEYS_PER_TYPE + 1); n > 0; n--) {
+	press (focused, &g_array_index (keys, BenchKey, key_pos));
+	key_pos = (key_pos + 1) % keys->len;
+    }
+}
+
+/* returns the index of the destroyed toplevel, the caller puts a new one
+ * in its place */
+static gint
+op_destroy (GRand *rand)
+{
+    gint i;
+
+    i = g_rand_int_range (rand, 0, stress_toplevels->len);
+    stress_toplevel_destroy (g_ptr_array_index (stress_toplevels, i));
+    g_ptr_array_index (stress_toplevels, i) = NULL;
+
+    return i;
+}
+
+static void
+iterate_main_loop (void)
+{
+    while (g_main_context_pending (NULL))
+	g_main_context_iteration (NULL, FALSE);
+}
+
+int
+main (int argc, char *argv[])
+{
+    GOptionContext *option_context;
+    GError *error = NULL;
+    GTypeModule *module;
+    GRand *rand;
+    GArray *samples[OP_LAST];
+    glong rss_start;
+    glong rss_half = 0;
+    glong rss_end;
+    guint64 start;
+    guint64 elapsed;
+    gint destroyed = 0;
+    gint i;
+
+    gtk_init (&argc, &argv);
+
+    option_context = g_option_context_new ("- stress the im context lifecycle");
+    g_option_context_add_main_entries (option_context, entries, NULL);
+    if (!g_option_context_parse (option_context, &argc, &argv, &error)) {
+	g_printerr ("%s\n", error->message);
+	return 1;
+    }
+    g_option_context_free (option_context);
+
+    if (opt_toplevels <= 0 || opt_entries <= 0) {
+	g_printerr ("need at least one toplevel and one entry\n");
+	return 1;
+    }
+
+    module = bench_module_load ();
+    keys = bench_keys_parse (default_keys);
+    rand = g_rand_new_with_seed (opt_seed);
+
+    for (i = 0; i < OP_LAST; i++)
+	samples[i] = bench_samples_new (0);
+
+    stress_toplevels = g_ptr_array_new ();
+    for (i = 0; i < opt_toplevels; i++) {
+	start = bench_now_ns ();
+	g_ptr_array_add (stress_toplevels, stress_toplevel_new ());
+	elapsed = bench_now_ns () - start;
+	g_array_append_val (samples[OP_CREATE], elapsed);
+    }
+    iterate_main_loop ();
+
+    rss_start = bench_rss_kb ();
+
+    for (i = 0; i < opt_operations; i++) {
+	gint pick = g_rand_int_range (rand, 0, 100);
+	gint op;
+
+	if (pick < WEIGHT_TYPE)
+	    op = OP_TYPE;
+	else if (pick < WEIGHT_TYPE + WEIGHT_FOCUS)
+	    op = OP_FOCUS;
+	else
+	    op = OP_DESTROY;
+
+	start = bench_now_ns ();
+	switch (op) {
+	case OP_TYPE:
+	    op_type (rand);
+	    break;
+	case OP_FOCUS:
+	    op_focus (rand);
+	    break;
+	case OP_DESTROY:
+	    destroyed = op_destroy (rand);
+	    break;
+	}
+	elapsed = bench_now_ns () - start;
+	g_array_append_val (samples[op], elapsed);
+
+	/* the new toplevel is counted as a create, not in the destroy */
+	if (op == OP_DESTROY) {
+	    start = bench_now_ns ();
+	    g_ptr_array_index (stress_toplevels, destroyed) =
+		stress_toplevel_new ();
+	    elapsed = bench_now_ns () - start;
+	    g_array_append_val (samples[OP_CREATE], elapsed);
+	}
+
+	iterate_main_loop ();
+
+	if (i == opt_operations / 2)
+	    rss_half = bench_rss_kb ();
+    }
+
+    rss_end = bench_rss_kb ();
+
+    printf ("toplevels           %d x %d entries\n", opt_toplevels, opt_entries);
+    printf ("operations          %d (seed %d)\n", opt_operations, opt_seed);
+    printf ("rss                 start %ld kB, half %ld kB, end %ld kB\n",
+	    rss_start, rss_half, rss_end);
+    printf ("rss growth          %.1f kB per 100000 operations"
+	    " (second half)\n",
+	    opt_operations > 1 ?
+		(rss_end - rss_half) * 100000.0 / (opt_operations / 2) : 0.0);
+    for (i = 0; i < OP_LAST; i++) {
+	bench_samples_print (op_names[i], samples[i]);
+	g_array_free (samples[i], TRUE);
+    }
+
+    for (i = 0; i < stress_toplevels->len; i++)
+	stress_toplevel_destroy (g_ptr_array_index (stress_toplevels, i));
+    g_ptr_array_free (stress_toplevels, TRUE);
+    g_array_free (keys, TRUE);
+    g_rand_free (rand);
+    bench_module_unload (module);
+
+    return 0;
+}
+
+/* vim: set sw=4 : */
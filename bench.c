@@ -0,0 +1,159 @@
+/* common helpers for the imhangul benchmark programs:
+ * time, memory and latency samples */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <glib.h>
+
+#include "bench.h"
+
+guint64
+bench_now_ns (void)
+{
+#ifdef HAVE_CLOCK_GETTIME
+    struct timespec ts;
+
+    clock_gettime (CLOCK_MONOTONIC, &ts);
+    return (guint64)ts.tv_sec * 1000000000 + ts.tv_nsec;
+#else
+    return (guint64)g_get_monotonic_time () * 1000;
+#endif
+}
+
+glong
+bench_rss_kb (void)
+{
+    FILE *file;
+    long size = 0;
+    long resident = 0;
+
+    file = fopen ("/proc/self/statm", "r");
+    if (file == NULL)
+	return -1;
+
+    if (fscanf (file, "%ld %ld", &size, &resident) != 2)
+	resident = -1;
+    fclose (file);
+
+    if (resident < 0)
+	return -1;
+
+    return resident * (sysconf (_SC_PAGESIZE) / 1024);
+}
+
+/* allocation counting
+ *
+ * g_mem_set_vtable() does nothing since GLib 2.46, so malloc itself is
+ * replaced here and forwards to the glibc allocator. Only the thread which
+ * set a counter is counted, so the worker threads of GLib and GTK+ do not
+ * add noise. */
+#ifdef BENCH_HAVE_ALLOC_COUNT
+extern void *__libc_malloc  (size_t size);
+extern void *__libc_calloc  (size_t nmemb, size_t size);
+extern void *__libc_realloc (void *ptr, size_t size);
+
+static __thread guint64 *bench_alloc_counter = NULL;
+
+void*
+malloc (size_t size)
+{
+    if (bench_alloc_counter != NULL)
+	(*bench_alloc_counter)++;
+    return __libc_malloc (size);
+}
+
+void*
+calloc (size_t nmemb, size_t size)
+{
+    if (bench_alloc_counter != NULL)
+	(*bench_alloc_counter)++;
+    return __libc_calloc (nmemb, size);
+}
+
+void*
+realloc (void *ptr, size_t size)
+{
+    if (bench_alloc_counter != NULL)
+	(*bench_alloc_counter)++;
+    return __libc_realloc (ptr, size);
+}
+
+guint64*
+bench_alloc_count_into (guint64 *counter)
+{
+    guint64 *old = bench_alloc_counter;
+
+    bench_alloc_counter = counter;
+    return old;
+}
+#else
+guint64*
+bench_alloc_count_into (guint64 *counter)
+{
+    return NULL;
+}
+#endif
+
+GArray*
+bench_samples_new (guint reserve)
+{
+    return g_array_sized_new (FALSE, FALSE, sizeof (guint64), reserve);
+}
+
+static gint
+bench_samples_compare (gconstpointer a, gconstpointer b)
+{
+    guint64 x = *(const guint64*)a;
+    guint64 y = *(const guint64*)b;
+
+    return (x > y) - (x < y);
+}
+
+void
+bench_samples_sort (GArray *samples)
+{
+    g_array_sort (samples, bench_samples_compare);
+}
+
+/* samples must be sorted */
+guint64
+bench_samples_percentile (GArray *samples, gdouble percentile)
+{
+    guint index_;
+
+    if (samples->len == 0)
+	return 0;
+
+    index_ = (guint)((samples->len - 1) * percentile / 100.0 + 0.5);
+    return g_array_index (samples, guint64, index_);
+}
+
+void
+bench_samples_print (const gchar *name, GArray *samples)
+{
+    guint i;
+    guint64 sum = 0;
+
+    bench_samples_sort (samples);
+    for (i = 0; i < samples->len; i++)
+	sum += g_array_index (samples, guint64, i);
+
+    printf ("%-20s n %-8u mean %-8.0f p50 %-8" G_GUINT64_FORMAT
+	    " p99 %-8" G_GUINT64_FORMAT " p999 %-8" G_GUINT64_FORMAT
+	    " max %" G_GUINT64_FORMAT " (ns)\n",
+	    name, samples->len,
+	    samples->len > 0 ? (gdouble)sum / samples->len : 0.0,
+	    bench_samples_percentile (samples, 50.0),
+	    bench_samples_percentile (samples, 99.0),
+	    bench_samples_percentile (samples, 99.9),
+	    bench_samples_percentile (samples, 100.0));
+}
+
+/* vim: set sw=4 : */
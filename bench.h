@@ -0,0 +1,72 @@
+/* common helpers for the imhangul benchmark programs */
+
+#ifndef __IM_HANGUL_BENCH_H__
+#define __IM_HANGUL_BENCH_H__
+
+#include <gtk/gtk.h>
+
+/* GTK+ im module entry points, implemented in imhangul.c */
+void          im_module_init   (GTypeModule *type_module);
+void          im_module_exit   (void);
+void          im_module_list   (const GtkIMContextInfo ***contexts,
+				int *n_contexts);
+GtkIMContext *im_module_create (const gchar *context_id);
+
+typedef struct _BenchKey BenchKey;
+struct _BenchKey {
+    guint keyval;
+    guint state;
+    guint16 keycode;
+};
+
+typedef struct _BenchClient BenchClient;
+struct _BenchClient {
+    GtkWidget *toplevel;
+    GtkWidget *entry;
+    GtkIMContext *context;
+    guint64 n_commits;
+    guint64 n_commit_bytes;
+    guint64 n_preedit_changed;
+    guint64 n_query_allocs;	/* allocations of get_preedit_string */
+};
+
+/* time and memory */
+guint64       bench_now_ns            (void);
+glong         bench_rss_kb            (void);
+
+/* allocation counting: while counter is set, every malloc, calloc and
+ * realloc of the calling thread increments it. Returns the previous
+ * counter. Does nothing if BENCH_HAVE_ALLOC_COUNT is not defined. */
+#if defined(__GLIBC__) && defined(__GNUC__)
+#define BENCH_HAVE_ALLOC_COUNT 1
+#endif
+guint64*      bench_alloc_count_into  (guint64 *counter);
+
+/* latency samples: GArray of guint64 nanoseconds */
+GArray*       bench_samples_new       (guint reserve);
+void          bench_samples_sort      (GArray *samples);
+guint64       bench_samples_percentile(GArray *samples, gdouble percentile);
+void          bench_samples_print     (const gchar *name, GArray *samples);
+
+/* im module */
+GTypeModule*  bench_module_load       (void);
+void          bench_module_unload     (GTypeModule *module);
+
+/* client widget bound to an im context, never shown on screen */
+BenchClient*  bench_client_new        (const gchar *keyboard);
+void          bench_client_free       (BenchClient *client);
+gboolean      bench_client_press      (BenchClient *client,
+				       const BenchKey *key);
+gboolean      bench_context_press     (GtkIMContext *context,
+				       GdkWindow *window,
+				       const BenchKey *key);
+
+/* key streams */
+GArray*       bench_keys_parse        (const gchar *text);
+GArray*       bench_keys_load         (const gchar *filename,
+				       GError **error);
+void          bench_key_from_keyval   (BenchKey *key, guint keyval);
+
+#endif /* __IM_HANGUL_BENCH_H__ */
+
+/* vim: set sw=4 : */
@@ -23,6 +23,10 @@
 
 #include <stdio.h>
 #include <string.h>
+#include <time.h>
+#ifdef HAVE_MALLOC_H
+#include <malloc.h>
+#endif
 #include <gtk/gtk.h>
 #include <gdk/gdkkeysyms.h>
 
@@ -30,6 +34,7 @@
 
 #include "gettext.h"
 #include "gtkimcontexthangul.h"
+#include "imhangul-keymap.h"
 
 enum {
   INPUT_MODE_DIRECT,
@@ -52,8 +57,24 @@ struct _Toplevel
   GtkWidget *widget;
   GtkWidget *status;
   GSList *contexts;
+  GtkIMContextHangul *focused;
   guint destroy_handler_id;
   guint configure_handler_id;
+  guint key_press_handler_id;
+  /* the key press the emission hook gave to the focused context */
+  GdkEventKey *hooked_event;
+  gboolean hooked_result;
+  /* the origin and the height of a client window, queried once and kept
+   * until the toplevel moves or resizes */
+  GdkWindow *geometry_window;
+  gint geometry_x;
+  gint geometry_y;
+  gint geometry_height;
+  /* the position the status window was moved to, and the tick which
+   * moves it on the next frame of the toplevel */
+  gint status_x;
+  gint status_y;
+  guint status_tick_id;
 };
 
 /* Candidate window */
@@ -119,9 +140,17 @@ static void	im_hangul_ic_cursor_location (GtkIMContext *context,
 
 /* asistant function for hangul composer */
 static inline gboolean im_hangul_is_modifier  (guint state);
-static inline gboolean im_hangul_is_hangul_key(GdkEventKey *key);
-static inline gboolean im_hangul_is_backspace (GdkEventKey *key);
-static inline void     im_hangul_ic_emit_preedit_changed (GtkIMContextHangul *hcontext);
+static void     im_hangul_ic_emit_preedit_changed (GtkIMContextHangul *hcontext);
+static void     im_hangul_ic_flush_preedit_changed (GtkIMContextHangul *hcontext);
+static void     im_hangul_ic_flush_commit_batch (GtkIMContextHangul *hcontext);
+#if GTK_CHECK_VERSION(3, 6, 0)
+static void     im_hangul_ic_on_input_purpose_changed (GObject *object,
+						       GParamSpec *pspec,
+						       gpointer data);
+#endif
+#if GTK_CHECK_VERSION(3, 8, 0)
+static void     im_hangul_ic_release_frame_clock (GtkIMContextHangul *hcontext);
+#endif
 
 /* commit functions */
 static void     im_hangul_ic_commit_by_slave (GtkIMContext *context,
@@ -181,6 +210,14 @@ static void       toplevel_append_context(Toplevel *toplevel,
 static void       toplevel_remove_context(Toplevel *toplevel,
 					  GtkIMContextHangul *context);
 static void       toplevel_delete(Toplevel *toplevel);
+static void       toplevel_get_window_geometry(Toplevel *toplevel,
+					       GdkWindow *window,
+					       gint *x, gint *y,
+					       gint *height);
+static void       toplevel_move_status_window(Toplevel *toplevel,
+					      GtkIMContextHangul *hcontext);
+static void       toplevel_queue_status_window_move(Toplevel *toplevel,
+					  GtkIMContextHangul *hcontext);
 
 static GtkWidget* status_window_new(GtkWidget *parent);
 
@@ -194,8 +231,9 @@ static GObjectClass *parent_class;
 
 static GSList          *toplevels = NULL;
 
-static guint		snooper_handler_id = 0;
-static GtkIMContext    *current_focused_ic = NULL;
+static guint		key_press_signal_id = 0;
+static gulong		key_press_hook_id = 0;
+static gpointer		key_press_widget_class = NULL;
 
 static HanjaTable*      hanja_table = NULL;
 static GArray*          hangul_keys = NULL;
@@ -204,9 +242,12 @@ static GArray*          hanja_keys = NULL;
 /* preferences */
 static gboolean		pref_use_capslock = FALSE;
 static gboolean		pref_use_status_window = FALSE;
-static gboolean		pref_use_dvorak = FALSE;
+static guint		pref_latin_layout = IM_HANGUL_LATIN_LAYOUT_QWERTY;
 static gboolean		pref_use_system_keymap = FALSE;
 static gboolean		pref_use_preedit_string = TRUE;
+static gboolean		pref_clear_preedit_on_commit = FALSE;
+static gboolean		pref_use_preedit_coalescing = FALSE;
+static gboolean		pref_use_commit_batching = FALSE;
 static void		(*im_hangul_preedit_attr)(GtkIMContextHangul *hic,
 						  PangoAttrList **attrs,
 						  gint start,
@@ -215,6 +256,126 @@ static void		(*im_hangul_preedit_attr)(GtkIMContextHangul *hic,
 static GdkColor		pref_fg = { 0, 0xeeee, 0, 0 };
 static GdkColor		pref_bg = { 0, 0xFFFF, 0xFFFF, 0xFFFF };
 
+/* debug
+ * IM_HANGUL_DEBUG 환경 변수나 설정 파일의 debug 항목으로 켠다.
+ *   IM_HANGUL_DEBUG=latency,signals,memory gedit */
+enum {
+  IM_HANGUL_DEBUG_LATENCY = 1 << 0,
+  IM_HANGUL_DEBUG_SIGNALS = 1 << 1,
+  IM_HANGUL_DEBUG_MEMORY  = 1 << 2
+};
+
+static const GDebugKey im_hangul_debug_keys[] = {
+  { "latency", IM_HANGUL_DEBUG_LATENCY },
+  { "signals", IM_HANGUL_DEBUG_SIGNALS },
+  { "memory",  IM_HANGUL_DEBUG_MEMORY }
+};
+
+static guint		im_hangul_debug_flags = 0;
+
+/* latency histograms
+ * bucket i counts the calls which took [2^i, 2^(i+1)) ns, the last bucket
+ * takes everything longer. The handlers of the signals emitted during the
+ * call are included, but the relayout and redraw of the client widget,
+ * which GTK+ does later from the main loop, are not. */
+#define LATENCY_N_BUCKETS 32
+
+enum {
+  LATENCY_FILTER_KEYPRESS,
+  LATENCY_RESET,
+  LATENCY_POPUP_CANDIDATE,
+  LATENCY_LAST
+};
+
+typedef struct _LatencyHistogram LatencyHistogram;
+struct _LatencyHistogram {
+  const char *name;
+  guint64 count;
+  guint64 sum;
+  guint64 max;
+  guint64 buckets[LATENCY_N_BUCKETS];
+};
+
+static LatencyHistogram latency_histograms[LATENCY_LAST] = {
+  { "filter_keypress" },
+  { "reset" },
+  { "popup_candidate_window" }
+};
+
+/* signal accounting
+ * Emission hooks count the signals of the hangul contexts, which the
+ * client widget receives, and of their GtkIMContextSimple slaves, which
+ * are forwarded by the *_by_slave handlers. The emissions of the hangul
+ * contexts during one filter_keypress call are its fan-out. */
+#define SIGNAL_FANOUT_MAX 8
+
+enum {
+  SIGNAL_PREEDIT_START,
+  SIGNAL_PREEDIT_CHANGED,
+  SIGNAL_PREEDIT_END,
+  SIGNAL_COMMIT,
+  SIGNAL_DELETE_SURROUNDING,
+  SIGNAL_LAST
+};
+
+typedef struct _SignalCounter SignalCounter;
+struct _SignalCounter {
+  const char *name;
+  guint id;
+  gulong hook_id;
+  guint64 hangul;
+  guint64 slave;
+};
+
+static SignalCounter signal_counters[SIGNAL_LAST] = {
+  { "preedit-start" },
+  { "preedit-changed" },
+  { "preedit-end" },
+  { "commit" },
+  { "delete-surrounding" }
+};
+
+static GQuark		signal_slave_quark = 0;
+static gpointer		signal_im_context_class = NULL;
+static guint64		signal_emissions = 0;
+static guint64		signal_n_keys = 0;
+static guint64		signal_fanout[SIGNAL_FANOUT_MAX + 1];
+
+/* memory accounting
+ * The size of an object is the growth of the malloc heap while it is made,
+ * so it includes everything GTK+ and libhangul allocate for it. Without
+ * mallinfo only the objects are counted. The counters are kept when the
+ * module is unloaded, since hanja_table is kept too. */
+enum {
+  MEMORY_CONTEXT,
+  MEMORY_SLAVE,
+  MEMORY_HANGUL_IC,
+  MEMORY_STATUS_WINDOW,
+  MEMORY_CANDIDATE_WINDOW,
+  MEMORY_CANDIDATE_STRING,
+  MEMORY_HANJA_TABLE,
+  MEMORY_LAST
+};
+
+typedef struct _MemoryCounter MemoryCounter;
+struct _MemoryCounter {
+  const char *name;
+  guint64 live;
+  guint64 peak;
+  guint64 created;
+  gint64 bytes;		/* sum of the sizes of all created objects */
+};
+
+static MemoryCounter memory_counters[MEMORY_LAST] = {
+  { "GtkIMContextHangul" },
+  { "GtkIMContextSimple" },
+  { "HangulInputContext" },
+  { "status window" },
+  { "candidate window" },
+  { "candidate_string" },
+  { "hanja_table" }
+};
+
 /* scanner */
 static const GScannerConfig im_hangul_scanner_config = {
     (
@@ -268,11 +429,16 @@ enum {
     TOKEN_ENABLE_CAPSLOCK,
     TOKEN_ENABLE_DVORAK,
     TOKEN_ENABLE_SYSTEM_KEYMAP,
+    TOKEN_ENABLE_PREEDIT_COALESCING,
+    TOKEN_ENABLE_COMMIT_BATCHING,
+    TOKEN_LATIN_LAYOUT,
+    TOKEN_CLEAR_PREEDIT_APPS,
     TOKEN_PREEDIT_STYLE,
     TOKEN_PREEDIT_STYLE_FG,
     TOKEN_PREEDIT_STYLE_BG,
     TOKEN_HANGUL_KEYS,
     TOKEN_HANJA_KEYS,
+    TOKEN_DEBUG,
 };
 
 static const struct {
@@ -288,11 +454,16 @@ static const struct {
     { "enable_capslock", TOKEN_ENABLE_CAPSLOCK },
     { "enable_dvorak", TOKEN_ENABLE_DVORAK },
     { "enable_system_keymap", TOKEN_ENABLE_SYSTEM_KEYMAP },
+    { "enable_preedit_coalescing", TOKEN_ENABLE_PREEDIT_COALESCING },
+    { "enable_commit_batching", TOKEN_ENABLE_COMMIT_BATCHING },
+    { "latin_layout", TOKEN_LATIN_LAYOUT },
+    { "clear_preedit_apps", TOKEN_CLEAR_PREEDIT_APPS },
     { "preedit_style", TOKEN_PREEDIT_STYLE },
     { "preedit_style_fg", TOKEN_PREEDIT_STYLE_FG },
     { "preedit_style_bg", TOKEN_PREEDIT_STYLE_BG },
     { "hangul_keys", TOKEN_HANGUL_KEYS },
     { "hanja_keys", TOKEN_HANJA_KEYS },
+    { "debug", TOKEN_DEBUG },
 };
 
 typedef struct _IMHangulAccelKey IMHangulAccelKey;
@@ -321,23 +492,427 @@ im_hangul_accel_list_append(GArray* accel_list,
     g_array_append_val(accel_list, accel_key);
 }
 
-static gboolean
-im_hangul_accel_list_has_key (GArray* accel_list, GdkEventKey* key)
+/* accelerator table
+ * 설정 파일을 읽은 다음 hangul_keys와 hanja_keys를 하나의 해시 테이블로 
+ * 만들어 두고 키 입력마다 이 테이블에서 찾는다. 보통의 글자 키는 
+ * keyval로 만든 bloom filter에서 바로 걸러진다. */
+enum {
+    IM_HANGUL_ACCEL_HANGUL = 1 << 0,
+    IM_HANGUL_ACCEL_HANJA  = 1 << 1
+};
+
+typedef struct _IMHangulAccelSlot IMHangulAccelSlot;
+struct _IMHangulAccelSlot {
+    guint keyval;
+    GdkModifierType modifier;
+    guint flags;		/* 0 if the slot is empty */
+};
+
+static IMHangulAccelSlot* accel_table = NULL;
+static guint		accel_table_mask = 0;
+static guint		accel_table_shift = 32;
+static guint64		accel_bloom = 0;
+static GdkModifierType	accel_mod_mask = 0;
+
+static inline guint64
+im_hangul_accel_bloom_bit (guint keyval)
+{
+    return G_GUINT64_CONSTANT(1) << ((keyval * 0x9e3779b1u) >> 26);
+}
+
+/* the slot is taken from the high bits of the product, as the modifier
+ * bits can not change the low bits of it */
+static inline guint
+im_hangul_accel_hash (guint keyval, GdkModifierType modifier)
+{
+    return (guint32)((keyval ^ (modifier << 16)) * 0x9e3779b1u)
+		>> accel_table_shift;
+}
+
+static void
+im_hangul_accel_table_insert (GArray* accel_list, guint flags)
 {
-    guint i; 
-    GdkModifierType default_mask = gtk_accelerator_get_default_mod_mask();
+    guint i;
 
     for (i = 0; i < accel_list->len; ++i) {
 	IMHangulAccelKey item;
+	guint n;
 
 	item = g_array_index(accel_list, IMHangulAccelKey, i);
-	if (key->keyval == item.keyval &&
-	    (key->state & default_mask) == item.modifier) {
-	    return TRUE;
+	n = im_hangul_accel_hash(item.keyval, item.modifier);
+	while (accel_table[n].flags != 0 &&
+	       (accel_table[n].keyval != item.keyval ||
+		accel_table[n].modifier != item.modifier)) {
+	    n = (n + 1) & accel_table_mask;
 	}
+
+	accel_table[n].keyval = item.keyval;
+	accel_table[n].modifier = item.modifier;
+	accel_table[n].flags |= flags;
+	accel_bloom |= im_hangul_accel_bloom_bit(item.keyval);
     }
+}
 
-    return FALSE;
+static void
+im_hangul_accel_table_build (void)
+{
+    guint n = hangul_keys->len + hanja_keys->len;
+    guint size = 8;
+    guint shift = 32 - 3;
+
+    /* keep the table at most half full */
+    while (size < n * 2) {
+	size *= 2;
+	shift--;
+    }
+
+    g_free(accel_table);
+    accel_table = g_new0(IMHangulAccelSlot, size);
+    accel_table_mask = size - 1;
+    accel_table_shift = shift;
+    accel_bloom = 0;
+    accel_mod_mask = gtk_accelerator_get_default_mod_mask();
+
+    im_hangul_accel_table_insert(hangul_keys, IM_HANGUL_ACCEL_HANGUL);
+    im_hangul_accel_table_insert(hanja_keys, IM_HANGUL_ACCEL_HANJA);
+}
+
+static void
+im_hangul_accel_table_free (void)
+{
+    g_free(accel_table);
+    accel_table = NULL;
+    accel_table_mask = 0;
+    accel_table_shift = 32;
+    accel_bloom = 0;
+}
+
+static inline guint
+im_hangul_accel_table_lookup (GdkEventKey* key)
+{
+    GdkModifierType modifier;
+    guint n;
+
+    if (!(accel_bloom & im_hangul_accel_bloom_bit(key->keyval)))
+	return 0;
+
+    modifier = key->state & accel_mod_mask;
+    n = im_hangul_accel_hash(key->keyval, modifier);
+    while (accel_table[n].flags != 0) {
+	if (accel_table[n].keyval == key->keyval &&
+	    accel_table[n].modifier == modifier)
+	    return accel_table[n].flags;
+	n = (n + 1) & accel_table_mask;
+    }
+
+    return 0;
+}
+
+/* key class table
+ * filter_keypress에서 keyval만 보고 판단하는 것들을 init할 때 미리 
+ * 계산해 둔다. Latin-1 영역(0x0000-0x00ff)과 기능키 영역(0xff00-0xffff)만 
+ * 테이블에 넣고 나머지 keyval은 accelerator의 bloom filter만 본다. */
+enum {
+    IM_HANGUL_KEY_SHIFT	    = 1 << 0,
+    IM_HANGUL_KEY_ESCAPE    = 1 << 1,
+    IM_HANGUL_KEY_BACKSPACE = 1 << 2,
+    IM_HANGUL_KEY_ACCEL	    = 1 << 3	/* in hangul_keys or hanja_keys */
+};
+
+static guint8 key_class_table[512];
+
+static inline guint
+im_hangul_key_class_index (guint keyval)
+{
+    if (keyval <= 0x00ff)
+	return keyval;
+    if (keyval >= 0xff00 && keyval <= 0xffff)
+	return 0x100 + (keyval & 0xff);
+    return G_MAXUINT;
+}
+
+static void
+im_hangul_key_class_table_build (void)
+{
+    guint i;
+
+    memset(key_class_table, 0, sizeof(key_class_table));
+
+    key_class_table[im_hangul_key_class_index(GDK_KEY_Shift_L)] |= IM_HANGUL_KEY_SHIFT;
+    key_class_table[im_hangul_key_class_index(GDK_KEY_Shift_R)] |= IM_HANGUL_KEY_SHIFT;
+    key_class_table[im_hangul_key_class_index(GDK_KEY_Escape)] |= IM_HANGUL_KEY_ESCAPE;
+    key_class_table[im_hangul_key_class_index(GDK_KEY_BackSpace)] |= IM_HANGUL_KEY_BACKSPACE;
+
+    for (i = 0; i <= accel_table_mask; ++i) {
+	guint n;
+
+	if (accel_table[i].flags == 0)
+	    continue;
+
+	n = im_hangul_key_class_index(accel_table[i].keyval);
+	if (n != G_MAXUINT)
+	    key_class_table[n] |= IM_HANGUL_KEY_ACCEL;
+    }
+}
+
+static inline guint
+im_hangul_key_class (guint keyval)
+{
+    guint n = im_hangul_key_class_index(keyval);
+
+    if (n != G_MAXUINT)
+	return key_class_table[n];
+
+    if (accel_bloom & im_hangul_accel_bloom_bit(keyval))
+	return IM_HANGUL_KEY_ACCEL;
+
+    return 0;
+}
+
+static inline guint64
+im_hangul_debug_now (void)
+{
+#ifdef HAVE_CLOCK_GETTIME
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (guint64)ts.tv_sec * 1000000000 + ts.tv_nsec;
+#else
+  return (guint64)g_get_monotonic_time() * 1000;
+#endif
+}
+
+static void
+im_hangul_latency_record (int which, guint64 start)
+{
+  LatencyHistogram *hist = &latency_histograms[which];
+  guint64 elapsed = im_hangul_debug_now() - start;
+  guint bucket = 0;
+
+  while (bucket < LATENCY_N_BUCKETS - 1 && (elapsed >> (bucket + 1)) != 0)
+    bucket++;
+
+  hist->count++;
+  hist->sum += elapsed;
+  if (elapsed > hist->max)
+    hist->max = elapsed;
+  hist->buckets[bucket]++;
+}
+
+static void
+im_hangul_latency_dump (void)
+{
+  int i;
+  int j;
+
+  for (i = 0; i < LATENCY_LAST; i++) {
+    LatencyHistogram *hist = &latency_histograms[i];
+
+    if (hist->count == 0)
+      continue;
+
+    g_printerr("imhangul: %s: n %" G_GUINT64_FORMAT
+	       " mean %" G_GUINT64_FORMAT " max %" G_GUINT64_FORMAT " ns\n",
+	       hist->name, hist->count, hist->sum / hist->count, hist->max);
+    for (j = 0; j < LATENCY_N_BUCKETS; j++) {
+      if (hist->buckets[j] == 0)
+	continue;
+      g_printerr("  >= %12" G_GUINT64_FORMAT " ns %12" G_GUINT64_FORMAT
+		 " %6.2f%%\n",
+		 j == 0 ? 0 : (guint64)1 << j, hist->buckets[j],
+		 100.0 * hist->buckets[j] / hist->count);
+    }
+  }
+
+  /* the module can be loaded again */
+  for (i = 0; i < LATENCY_LAST; i++) {
+    LatencyHistogram *hist = &latency_histograms[i];
+    const char *name = hist->name;
+
+    memset(hist, 0, sizeof(LatencyHistogram));
+    hist->name = name;
+  }
+}
+
+static gboolean
+im_hangul_signal_emission_hook (GSignalInvocationHint *ihint,
+				guint n_param_values,
+				const GValue *param_values,
+				gpointer data)
+{
+  SignalCounter *counter = data;
+  GObject *instance = g_value_get_object(&param_values[0]);
+
+  if (GTK_IS_IM_CONTEXT_HANGUL(instance)) {
+    counter->hangul++;
+    signal_emissions++;
+  } else if (g_object_get_qdata(instance, signal_slave_quark) != NULL) {
+    counter->slave++;
+  }
+
+  return TRUE;
+}
+
+static void
+im_hangul_signal_hooks_add (void)
+{
+  int i;
+
+  signal_slave_quark = g_quark_from_static_string("im-hangul-slave");
+
+  /* the signals exist after the class is initialized */
+  signal_im_context_class = g_type_class_ref(GTK_TYPE_IM_CONTEXT);
+  for (i = 0; i < SIGNAL_LAST; i++) {
+    SignalCounter *counter = &signal_counters[i];
+
+    counter->id = g_signal_lookup(counter->name, GTK_TYPE_IM_CONTEXT);
+    counter->hook_id = g_signal_add_emission_hook(counter->id, 0,
+					 im_hangul_signal_emission_hook,
+					 counter, NULL);
+  }
+}
+
+static void
+im_hangul_signal_hooks_remove (void)
+{
+  int i;
+
+  for (i = 0; i < SIGNAL_LAST; i++) {
+    SignalCounter *counter = &signal_counters[i];
+
+    if (counter->hook_id != 0) {
+      g_signal_remove_emission_hook(counter->id, counter->hook_id);
+      counter->hook_id = 0;
+    }
+  }
+
+  if (signal_im_context_class != NULL) {
+    g_type_class_unref(signal_im_context_class);
+    signal_im_context_class = NULL;
+  }
+}
+
+static void
+im_hangul_signal_record_keypress (guint64 emissions)
+{
+  signal_n_keys++;
+  signal_fanout[MIN(emissions, SIGNAL_FANOUT_MAX)]++;
+}
+
+static void
+im_hangul_signal_dump (void)
+{
+  int i;
+  guint64 hangul = 0;
+
+  for (i = 0; i < SIGNAL_LAST; i++)
+    hangul += signal_counters[i].hangul;
+
+  g_printerr("imhangul: signals: keys %" G_GUINT64_FORMAT
+	     " emissions %" G_GUINT64_FORMAT " (%.2f/key)\n",
+	     signal_n_keys, hangul,
+	     signal_n_keys > 0 ? (double)hangul / signal_n_keys : 0.0);
+  for (i = 0; i < SIGNAL_LAST; i++) {
+    g_printerr("  %-20s hangul %12" G_GUINT64_FORMAT
+	       " slave %12" G_GUINT64_FORMAT "\n",
+	       signal_counters[i].name,
+	       signal_counters[i].hangul, signal_counters[i].slave);
+  }
+
+  g_printerr("imhangul: signals per key\n");
+  for (i = 0; i <= SIGNAL_FANOUT_MAX; i++) {
+    if (signal_fanout[i] == 0)
+      continue;
+    g_printerr("  %s%d %12" G_GUINT64_FORMAT " %6.2f%%\n",
+	       i == SIGNAL_FANOUT_MAX ? ">=" : "  ", i, signal_fanout[i],
+	       100.0 * signal_fanout[i] / signal_n_keys);
+  }
+
+  /* the module can be loaded again */
+  for (i = 0; i < SIGNAL_LAST; i++) {
+    signal_counters[i].hangul = 0;
+    signal_counters[i].slave = 0;
+  }
+  memset(signal_fanout, 0, sizeof(signal_fanout));
+  signal_emissions = 0;
+  signal_n_keys = 0;
+}
+
+static gint64
+im_hangul_memory_mark (void)
+{
+  if (!(im_hangul_debug_flags & IM_HANGUL_DEBUG_MEMORY))
+    return 0;
+
+#if defined(HAVE_MALLINFO2)
+  {
+    struct mallinfo2 info = mallinfo2();
+    return info.uordblks + info.hblkhd;
+  }
+#elif defined(HAVE_MALLINFO)
+  {
+    struct mallinfo info = mallinfo();
+    return (gint64)(unsigned)info.uordblks + (unsigned)info.hblkhd;
+  }
+#else
+  return 0;
+#endif
+}
+
+static void
+im_hangul_memory_created (int which, gint64 bytes)
+{
+  MemoryCounter *counter = &memory_counters[which];
+
+  if (!(im_hangul_debug_flags & IM_HANGUL_DEBUG_MEMORY))
+    return;
+
+  counter->live++;
+  counter->created++;
+  counter->bytes += bytes;
+  if (counter->live > counter->peak)
+    counter->peak = counter->live;
+}
+
+static void
+im_hangul_memory_destroyed (int which)
+{
+  if (!(im_hangul_debug_flags & IM_HANGUL_DEBUG_MEMORY))
+    return;
+
+  if (memory_counters[which].live > 0)
+    memory_counters[which].live--;
+}
+
+static void
+im_hangul_memory_dump (void)
+{
+  int i;
+  gint64 total = 0;
+
+  g_printerr("imhangul: memory\n");
+  g_printerr("  %-20s %8s %8s %8s %10s %10s\n",
+	     "", "live", "peak", "created", "bytes/each", "live kB");
+  for (i = 0; i < MEMORY_LAST; i++) {
+    MemoryCounter *counter = &memory_counters[i];
+    gint64 each = 0;
+
+    if (counter->created > 0)
+      each = counter->bytes / (gint64)counter->created;
+    total += each * (gint64)counter->live;
+
+    g_printerr("  %-20s %8" G_GUINT64_FORMAT " %8" G_GUINT64_FORMAT
+	       " %8" G_GUINT64_FORMAT " %10" G_GINT64_FORMAT
+	       " %10" G_GINT64_FORMAT "\n",
+	       counter->name, counter->live, counter->peak, counter->created,
+	       each, each * (gint64)counter->live / 1024);
+  }
+  g_printerr("  %-20s %8s %8s %8s %10s %10" G_GINT64_FORMAT "\n",
+	     "total", "", "", "", "", total / 1024);
+#if defined(HAVE_MALLINFO2) || defined(HAVE_MALLINFO)
+  g_printerr("  malloc heap in use by the process: %" G_GINT64_FORMAT " kB\n",
+	     im_hangul_memory_mark() / 1024);
+#endif
 }
 
 static void
@@ -364,6 +939,19 @@ set_preedit_style (const char *style)
     }
 }
 
+static void
+set_latin_layout (const char *name)
+{
+    guint i;
+
+    for (i = 0; i < IM_HANGUL_LATIN_LAYOUT_LAST; i++) {
+	if (g_ascii_strcasecmp(name, im_hangul_latin_layout_names[i]) == 0) {
+	    pref_latin_layout = i;
+	    return;
+	}
+    }
+}
+
 static void
 im_hangul_config_unknown_token(GScanner* scanner)
 {
@@ -424,6 +1012,33 @@ start:
     }
 }
 
+/* clear_preedit_apps에 지금 프로그램의 이름이 있으면 
+ * commit하기 전에 preedit string을 지우는 예전 방식으로 동작한다. */
+static void
+im_hangul_config_app_list_parse(GScanner* scanner)
+{
+    guint type;
+    const gchar* prgname = g_get_prgname();
+
+start:
+    type = g_scanner_get_next_token(scanner);
+    if (type == G_TOKEN_STRING) {
+	GTokenValue value;
+
+	value = g_scanner_cur_value(scanner);
+	if (prgname != NULL && g_pattern_match_simple(value.v_string, prgname))
+	    pref_clear_preedit_on_commit = TRUE;
+
+	type = g_scanner_peek_next_token(scanner);
+	if (type == G_TOKEN_COMMA) {
+	    g_scanner_get_next_token(scanner);
+	    goto start;
+	}
+    } else {
+	im_hangul_config_unknown_token(scanner);
+    }
+}
+
 static void
 im_hangul_config_parse(void)
 {
@@ -502,10 +1117,9 @@ im_hangul_config_parse(void)
 	    type = g_scanner_get_next_token(scanner);
 	    if (type == G_TOKEN_EQUAL_SIGN) {
 		type = g_scanner_get_next_token(scanner);
+		/* false는 latin_layout으로 정한 자판을 그대로 둔다 */
 		if (type == TOKEN_TRUE) {
-		    pref_use_dvorak = TRUE;
-		} else {
-		    pref_use_dvorak = FALSE;
+		    pref_latin_layout = IM_HANGUL_LATIN_LAYOUT_DVORAK;
 		}
 	    }
 	} else if (type == TOKEN_ENABLE_SYSTEM_KEYMAP) {
@@ -518,6 +1132,36 @@ im_hangul_config_parse(void)
 		    pref_use_system_keymap = FALSE;
 		}
 	    }
+	} else if (type == TOKEN_ENABLE_PREEDIT_COALESCING) {
+	    type = g_scanner_get_next_token(scanner);
+	    if (type == G_TOKEN_EQUAL_SIGN) {
+		type = g_scanner_get_next_token(scanner);
+		if (type == TOKEN_TRUE) {
+		    pref_use_preedit_coalescing = TRUE;
+		} else {
+		    pref_use_preedit_coalescing = FALSE;
+		}
+	    }
+	} else if (type == TOKEN_ENABLE_COMMIT_BATCHING) {
+	    type = g_scanner_get_next_token(scanner);
+	    if (type == G_TOKEN_EQUAL_SIGN) {
+		type = g_scanner_get_next_token(scanner);
+		if (type == TOKEN_TRUE) {
+		    pref_use_commit_batching = TRUE;
+		} else {
+		    pref_use_commit_batching = FALSE;
+		}
+	    }
+	} else if (type == TOKEN_LATIN_LAYOUT) {
+	    type = g_scanner_get_next_token(scanner);
+	    if (type == G_TOKEN_EQUAL_SIGN) {
+		type = g_scanner_get_next_token(scanner);
+		if (type == G_TOKEN_STRING) {
+		    value = g_scanner_cur_value(scanner);
+		    str = value.v_string;
+		    set_latin_layout(str);
+		}
+	    }
 	} else if (type == TOKEN_PREEDIT_STYLE) {
 	    type = g_scanner_get_next_token(scanner);
 	    if (type == G_TOKEN_EQUAL_SIGN) {
@@ -558,6 +1202,23 @@ im_hangul_config_parse(void)
 	    if (type == G_TOKEN_EQUAL_SIGN) {
 		im_hangul_config_accel_list_parse(scanner, hanja_keys);
 	    }
+	} else if (type == TOKEN_CLEAR_PREEDIT_APPS) {
+	    type = g_scanner_get_next_token(scanner);
+	    if (type == G_TOKEN_EQUAL_SIGN) {
+		im_hangul_config_app_list_parse(scanner);
+	    }
+	} else if (type == TOKEN_DEBUG) {
+	    type = g_scanner_get_next_token(scanner);
+	    if (type == G_TOKEN_EQUAL_SIGN) {
+		type = g_scanner_get_next_token(scanner);
+		if (type == G_TOKEN_STRING) {
+		    value = g_scanner_cur_value(scanner);
+		    str = value.v_string;
+		    im_hangul_debug_flags |= g_parse_debug_string(str,
+					    im_hangul_debug_keys,
+					    G_N_ELEMENTS(im_hangul_debug_keys));
+		}
+	    }
 	} else {
 	    im_hangul_config_unknown_token(scanner);
 	}
@@ -615,7 +1276,13 @@ im_hangul_class_init (GtkIMContextHangulClass *klass)
 static void 
 im_hangul_ic_init (GtkIMContextHangul *hcontext)
 {
+  gint64 mark;
+  gint64 slave_size;
+  gint64 hic_size;
+
+  mark = im_hangul_memory_mark();
   hcontext->slave = gtk_im_context_simple_new();
+  slave_size = im_hangul_memory_mark() - mark;
   hcontext->slave_preedit_started = FALSE;
   g_signal_connect(hcontext->slave, "commit",
 		   G_CALLBACK(im_hangul_ic_commit_by_slave), hcontext);
@@ -629,23 +1296,59 @@ im_hangul_ic_init (GtkIMContextHangul *hcontext)
 		   G_CALLBACK(im_hangul_ic_delete_surrounding_by_slave), hcontext);
   g_signal_connect(hcontext->slave, "retrieve-surrounding",
 		   G_CALLBACK(im_hangul_ic_retrieve_surrounding_by_slave), hcontext);
+  if (im_hangul_debug_flags & IM_HANGUL_DEBUG_SIGNALS)
+    g_object_set_qdata(G_OBJECT(hcontext->slave), signal_slave_quark, hcontext);
 
   hcontext->client_window = NULL;
   hcontext->toplevel = NULL;
   hcontext->button_press_handler = 0;
+  hcontext->style_updated_handler = 0;
+  hcontext->size_allocate_handler = 0;
   hcontext->cursor.x = 0;
   hcontext->cursor.y = 0;
   hcontext->cursor.width = -1;
   hcontext->cursor.height = -1;
 
+  mark = im_hangul_memory_mark();
   hcontext->hic = hangul_ic_new("2");
-  hcontext->preedit = g_string_new(NULL);
+  hic_size = im_hangul_memory_mark() - mark;
+  hcontext->preedit_buffers[0].len = 0;
+  hcontext->preedit_buffers[0].utf8_len = 0;
+  hcontext->preedit_buffers[0].ucs[0] = 0;
+  hcontext->preedit_buffers[0].utf8[0] = '\0';
+  hcontext->preedit = &hcontext->preedit_buffers[0];
+  hcontext->preedit_serial = 0;
+  hcontext->preedit_attrs_serial = 0;
+  hcontext->preedit_attrs = NULL;
+#if GTK_CHECK_VERSION(3, 8, 0)
+  hcontext->frame_clock = NULL;
+  hcontext->frame_clock_handler = 0;
+#endif
+  hcontext->preedit_changed_pending = FALSE;
+
+  hcontext->commit_batch = NULL;
+  hcontext->commit_batch_idle = 0;
+  hcontext->commit_batching = FALSE;
+
+  hcontext->filtered_key_time = 0;
+  hcontext->filtered_key_code = 0;
+  hcontext->filtered_keyval = 0;
 
   hcontext->candidate = NULL;
   hcontext->candidate_string = NULL;
 
   /* options */
   hcontext->use_preedit = TRUE;
+  hcontext->passthrough = FALSE;
+
+#if GTK_CHECK_VERSION(3, 6, 0)
+  g_signal_connect(hcontext, "notify::input-purpose",
+		   G_CALLBACK(im_hangul_ic_on_input_purpose_changed), NULL);
+#endif
+
+  im_hangul_memory_created(MEMORY_SLAVE, slave_size);
+  im_hangul_memory_created(MEMORY_HANGUL_IC, hic_size);
+  im_hangul_memory_created(MEMORY_CONTEXT, sizeof(GtkIMContextHangul));
 }
 
 static void
@@ -653,12 +1356,35 @@ im_hangul_ic_finalize (GObject *object)
 {
   GtkIMContextHangul *hic = GTK_IM_CONTEXT_HANGUL(object);
 
+  /* no one is listening any more */
+  hic->preedit_changed_pending = FALSE;
+  hic->commit_batching = FALSE;
+  if (hic->commit_batch_idle != 0) {
+    g_source_remove(hic->commit_batch_idle);
+    hic->commit_batch_idle = 0;
+  }
+  if (hic->commit_batch != NULL) {
+    g_string_free(hic->commit_batch, TRUE);
+    hic->commit_batch = NULL;
+  }
+
   if (hic->client_window != NULL) {
     im_hangul_ic_set_client_window (GTK_IM_CONTEXT(object), NULL);
   }
 
   hangul_ic_delete(hic->hic);
-  g_string_free(hic->preedit, TRUE);
+  im_hangul_memory_destroyed(MEMORY_HANGUL_IC);
+
+  if (hic->preedit_attrs != NULL) {
+    pango_attr_list_unref(hic->preedit_attrs);
+    hic->preedit_attrs = NULL;
+  }
+
+  if (hic->candidate_string != NULL) {
+    g_array_free(hic->candidate_string, TRUE);
+    hic->candidate_string = NULL;
+    im_hangul_memory_destroyed(MEMORY_CANDIDATE_STRING);
+  }
 
   gtk_im_context_reset(hic->slave);
   g_signal_handlers_disconnect_by_func(hic->slave,
@@ -666,10 +1392,35 @@ im_hangul_ic_finalize (GObject *object)
 				       object);
   g_object_unref(G_OBJECT(hic->slave));
   hic->slave = NULL;
+  im_hangul_memory_destroyed(MEMORY_SLAVE);
+  im_hangul_memory_destroyed(MEMORY_CONTEXT);
 
   G_OBJECT_CLASS(parent_class)->finalize (object);
-  if ((GObject*)current_focused_ic == object)
-    current_focused_ic = NULL;
+}
+
+static void
+im_hangul_ic_on_style_updated (GtkWidget *widget, gpointer data)
+{
+    GtkIMContextHangul *hcontext = GTK_IM_CONTEXT_HANGUL(data);
+
+    /* reverse and shade styles take the colors of the client widget */
+    hcontext->preedit_serial++;
+}
+
+static void
+im_hangul_ic_on_size_allocate (GtkWidget *widget, GdkRectangle *allocation,
+			       gpointer data)
+{
+    GtkIMContextHangul *hcontext = GTK_IM_CONTEXT_HANGUL(data);
+    Toplevel *toplevel = hcontext->toplevel;
+
+    /* the client widget has moved inside the toplevel, by a relayout or
+     * a paned, and the origin of its window may not be the same */
+    if (toplevel != NULL &&
+	toplevel->geometry_window == hcontext->client_window) {
+	toplevel->geometry_window = NULL;
+	toplevel_queue_status_window_move(toplevel, hcontext);
+    }
 }
 
 static void
@@ -687,6 +1438,15 @@ im_hangul_ic_set_client_window (GtkIMContext *context,
     if (hcontext->client_window == client_window)
 	return;
 
+    im_hangul_ic_flush_commit_batch(hcontext);
+    im_hangul_ic_flush_preedit_changed(hcontext);
+#if GTK_CHECK_VERSION(3, 8, 0)
+    im_hangul_ic_release_frame_clock(hcontext);
+#endif
+
+    /* reverse and shade styles take the colors of the client widget */
+    hcontext->preedit_serial++;
+
     if (hcontext->toplevel != NULL)
 	toplevel_remove_context(hcontext->toplevel, hcontext);
 
@@ -696,12 +1456,35 @@ im_hangul_ic_set_client_window (GtkIMContext *context,
 	    g_signal_handler_disconnect (widget,
 		    hcontext->button_press_handler);
 	}
+	if (widget != NULL && hcontext->style_updated_handler != 0) {
+	    g_signal_handler_disconnect (widget,
+		    hcontext->style_updated_handler);
+	}
+	if (widget != NULL && hcontext->size_allocate_handler != 0) {
+	    g_signal_handler_disconnect (widget,
+		    hcontext->size_allocate_handler);
+	}
 	hcontext->button_press_handler = 0;
+	hcontext->style_updated_handler = 0;
+	hcontext->size_allocate_handler = 0;
 	hcontext->client_window = NULL;
 	hcontext->toplevel = NULL;
 	return;
     }
 
+    if (hcontext->client_window != NULL) {
+	gdk_window_get_user_data (hcontext->client_window, (gpointer)&widget);
+	if (widget != NULL && hcontext->style_updated_handler != 0)
+	    g_signal_handler_disconnect (widget,
+		    hcontext->style_updated_handler);
+	if (widget != NULL && hcontext->size_allocate_handler != 0)
+	    g_signal_handler_disconnect (widget,
+		    hcontext->size_allocate_handler);
+	hcontext->style_updated_handler = 0;
+	hcontext->size_allocate_handler = 0;
+	widget = NULL;
+    }
+
     hcontext->client_window = client_window;
 
     gdk_window_get_user_data (hcontext->client_window, (gpointer)&widget);
@@ -712,6 +1495,12 @@ im_hangul_ic_set_client_window (GtkIMContext *context,
 	hcontext->button_press_handler =
 		g_signal_connect (G_OBJECT (widget), "button-press-event",
 			G_CALLBACK(im_hangul_on_button_press), hcontext);
+	hcontext->style_updated_handler =
+		g_signal_connect (G_OBJECT (widget), "style-updated",
+			G_CALLBACK(im_hangul_ic_on_style_updated), hcontext);
+	hcontext->size_allocate_handler =
+		g_signal_connect (G_OBJECT (widget), "size-allocate",
+			G_CALLBACK(im_hangul_ic_on_size_allocate), hcontext);
     }
 }
 
@@ -730,17 +1519,113 @@ gtk_im_context_hangul_select_keyboard(GtkIMContextHangul *hcontext,
     hangul_ic_select_keyboard(hcontext->hic, keyboard);
 }
 
+gboolean
+gtk_im_context_hangul_filter_keypress(GtkIMContextHangul *hcontext,
+				      GdkEventKey *key)
+{
+    g_return_val_if_fail (hcontext != NULL, FALSE);
+    g_return_val_if_fail (key != NULL, FALSE);
+
+    hcontext->filtered_key_time = key->time;
+    hcontext->filtered_key_code = key->hardware_keycode;
+    hcontext->filtered_keyval = key->keyval;
+
+    return im_hangul_ic_filter_keypress(GTK_IM_CONTEXT(hcontext), key);
+}
+
+/* _HANGUL_INPUT_MODE
+ * 입력 모드는 root window의 property로 알린다. focus가 옮겨갈 때마다
+ * 바뀌므로 screen마다 마지막으로 알린 값을 기억해 두고, 값이 바뀌었을 때만
+ * idle에서 한번 property를 바꾼다. remote X에서는 요청 하나하나가 느리다. */
+typedef struct _InputModeInfo InputModeInfo;
+struct _InputModeInfo {
+  GdkScreen *screen;
+  int published;	/* -1 if nothing is published yet */
+  int pending;
+  guint idle_id;
+};
+
+static GSList  *input_mode_infos = NULL;
+static GdkAtom  input_mode_atom = GDK_NONE;
+static GdkAtom  input_mode_type_atom = GDK_NONE;
+
+static void
+input_mode_info_publish (InputModeInfo *info)
+{
+  GdkWindow *root_window;
+  long data;
+
+  if (info->pending == info->published)
+    return;
+
+  if (input_mode_atom == GDK_NONE) {
+    input_mode_atom = gdk_atom_intern_static_string ("_HANGUL_INPUT_MODE");
+    input_mode_type_atom = gdk_atom_intern_static_string ("INTEGER");
+  }
+
+  root_window = gdk_screen_get_root_window(info->screen);
+  data = info->pending;
+  gdk_property_change (root_window,
+		       input_mode_atom, input_mode_type_atom,
+		       32, GDK_PROP_MODE_REPLACE,
+		       (const guchar *)&data, 1);
+  info->published = info->pending;
+}
+
+static gboolean
+input_mode_info_on_idle (gpointer data)
+{
+  InputModeInfo *info = data;
+
+  info->idle_id = 0;
+  input_mode_info_publish (info);
+  return FALSE;
+}
+
+static void
+input_mode_info_delete (InputModeInfo *info)
+{
+  if (info->idle_id != 0)
+    g_source_remove (info->idle_id);
+  input_mode_infos = g_slist_remove (input_mode_infos, info);
+  g_free (info);
+}
+
+static InputModeInfo *
+input_mode_info_get (GdkScreen *screen)
+{
+  InputModeInfo *info;
+
+  info = g_object_get_data (G_OBJECT(screen), "gtk-imhangul-input-mode-info");
+  if (info == NULL) {
+    info = g_new (InputModeInfo, 1);
+    info->screen = screen;
+    info->published = -1;
+    info->pending = -1;
+    info->idle_id = 0;
+    g_object_set_data_full (G_OBJECT(screen), "gtk-imhangul-input-mode-info",
+			    info, (GDestroyNotify)input_mode_info_delete);
+    input_mode_infos = g_slist_prepend (input_mode_infos, info);
+  }
+
+  return info;
+}
+
 static void
 im_hangul_set_input_mode_info_for_screen (GdkScreen *screen, int state)
 {
   if (screen != NULL) {
-    GdkWindow *root_window = gdk_screen_get_root_window(screen);
-    long data = state;
-    gdk_property_change (root_window,
-			 gdk_atom_intern ("_HANGUL_INPUT_MODE", FALSE),
-			 gdk_atom_intern ("INTEGER", FALSE),
-			 32, GDK_PROP_MODE_REPLACE,
-			 (const guchar *)&data, 1);
+    InputModeInfo *info = input_mode_info_get (screen);
+
+    info->pending = state;
+    if (info->pending == info->published) {
+      if (info->idle_id != 0) {
+	g_source_remove (info->idle_id);
+	info->idle_id = 0;
+      }
+    } else if (info->idle_id == 0) {
+      info->idle_id = g_idle_add (input_mode_info_on_idle, info);
+    }
   }
 }
 
@@ -934,18 +1819,75 @@ im_hangul_get_preedit_string (GtkIMContext *context, gchar **str,
     if (ic->slave_preedit_started) {
 	gtk_im_context_get_preedit_string(ic->slave, str, attrs, cursor_pos); 
     } else {
-	len = g_utf8_strlen(ic->preedit->str, -1);
-	if (attrs)
-	    im_hangul_preedit_attr(ic, attrs, 0, ic->preedit->len);
+	len = ic->preedit->len;
+	if (attrs) {
+	    /* GTK+ widgets ask several times for the same preedit string,
+	     * so the attribute list is made only once for each string and
+	     * the callers get a copy of it */
+	    if (ic->preedit_attrs == NULL ||
+		ic->preedit_attrs_serial != ic->preedit_serial) {
+		if (ic->preedit_attrs != NULL)
+		    pango_attr_list_unref(ic->preedit_attrs);
+		im_hangul_preedit_attr(ic, &ic->preedit_attrs,
+				       0, ic->preedit->utf8_len);
+		ic->preedit_attrs_serial = ic->preedit_serial;
+	    }
+	    *attrs = pango_attr_list_copy(ic->preedit_attrs);
+	}
 
 	if (cursor_pos)
 	    *cursor_pos = len;
 
 	if (str)
-	    *str = g_strdup(ic->preedit->str);
+	    *str = g_strndup(ic->preedit->utf8, ic->preedit->utf8_len);
     }
 }
 
+#if GTK_CHECK_VERSION(3, 6, 0)
+/* 암호, 숫자, 전화번호, URL, 이메일 입력란에서는 한글을 조합하지 않고
+ * 모든 키를 바로 slave로 보낸다. */
+static void
+im_hangul_ic_on_input_purpose_changed (GObject *object,
+				       GParamSpec *pspec,
+				       gpointer data)
+{
+  GtkIMContextHangul *hcontext = GTK_IM_CONTEXT_HANGUL(object);
+  GtkInputPurpose purpose;
+  gboolean passthrough;
+
+  g_object_get(object, "input-purpose", &purpose, NULL);
+
+  switch (purpose) {
+    case GTK_INPUT_PURPOSE_DIGITS:
+    case GTK_INPUT_PURPOSE_NUMBER:
+    case GTK_INPUT_PURPOSE_PHONE:
+    case GTK_INPUT_PURPOSE_URL:
+    case GTK_INPUT_PURPOSE_EMAIL:
+    case GTK_INPUT_PURPOSE_PASSWORD:
+    case GTK_INPUT_PURPOSE_PIN:
+      passthrough = TRUE;
+      break;
+    default:
+      passthrough = FALSE;
+      break;
+  }
+
+  if (passthrough == hcontext->passthrough)
+    return;
+
+  if (passthrough) {
+    im_hangul_ic_reset(GTK_IM_CONTEXT(hcontext));
+    im_hangul_ic_hide_status_window(hcontext);
+    hcontext->passthrough = TRUE;
+  } else {
+    hcontext->passthrough = FALSE;
+    if (hcontext->toplevel != NULL && hcontext->toplevel->focused == hcontext)
+      im_hangul_set_input_mode(hcontext,
+			       im_hangul_ic_get_toplevel_input_mode(hcontext));
+  }
+}
+#endif
+
 static void
 im_hangul_ic_focus_in (GtkIMContext *context)
 {
@@ -955,48 +1897,190 @@ im_hangul_ic_focus_in (GtkIMContext *context)
   g_return_if_fail (context != NULL);
 
   hcontext = GTK_IM_CONTEXT_HANGUL(context);
-  input_mode = im_hangul_ic_get_toplevel_input_mode(hcontext);
-  im_hangul_set_input_mode(hcontext, input_mode);
+  if (!hcontext->passthrough) {
+    input_mode = im_hangul_ic_get_toplevel_input_mode(hcontext);
+    im_hangul_set_input_mode(hcontext, input_mode);
+  }
+
+  if (hcontext->toplevel != NULL)
+    hcontext->toplevel->focused = hcontext;
+}
+
+/* 한글 음절과 자모는 모두 U+0800 ~ U+FFFF 범위에 있으므로 UTF-8로는 
+ * 3바이트가 된다. 그 경우는 바로 계산하고 나머지는 glib에 맡긴다. */
+static inline int
+im_hangul_ucs_to_utf8(ucschar c, gchar* buf)
+{
+    if (c >= 0x800 && c <= 0xffff) {
+	buf[0] = 0xe0 | (c >> 12);
+	buf[1] = 0x80 | ((c >> 6) & 0x3f);
+	buf[2] = 0x80 | (c & 0x3f);
+	return 3;
+    }
 
-  current_focused_ic = context;
+    return g_unichar_to_utf8(c, buf);
+}
+
+/* commit string은 보통 몇 글자 되지 않으므로 호출한 쪽의 buf에 변환한다.
+ * buf에 다 들어가지 않을 때만 새로 할당한 스트링을 돌려주므로, 
+ * 리턴값이 buf가 아니면 g_free()해야 한다. */
+#define IM_HANGUL_COMMIT_BUF_SIZE 128
+
+static gchar*
+im_hangul_ucs4_to_utf8(const ucschar* str, gchar* buf, gsize size)
+{
+    const ucschar* s;
+    gchar* p = buf;
+
+    for (s = str; *s != 0; s++) {
+	/* UTF-8로 한 글자는 6바이트를 넘지 않는다. */
+	if (p + 6 >= buf + size)
+	    return g_ucs4_to_utf8(str, -1, NULL, NULL, NULL);
+	p += im_hangul_ucs_to_utf8(*s, p);
+    }
+    *p = '\0';
+
+    return buf;
 }
 
 static void
 im_hangul_ic_set_preedit(GtkIMContextHangul* hic, const ucschar* preedit)
 {
     int i;
-    char* old;
-
-    old = g_strdup(hic->preedit->str);
-
-    g_string_assign(hic->preedit, "");
+    IMHangulPreedit* old;
+    IMHangulPreedit* new;
+    gboolean started;
+    gboolean changed;
+    gboolean ended;
+
+    /* 이전 preedit string은 다른 버퍼에 그대로 두고 비교한다. */
+    old = hic->preedit;
+    if (old == &hic->preedit_buffers[0])
+	new = &hic->preedit_buffers[1];
+    else
+	new = &hic->preedit_buffers[0];
+
+    new->len = 0;
+    new->utf8_len = 0;
     if (preedit != NULL) {
-	for (i = 0; preedit[i] != 0; i++) {
-	    g_string_append_unichar(hic->preedit, preedit[i]);
+	for (i = 0; preedit[i] != 0 && i < IM_HANGUL_PREEDIT_MAX; i++) {
+	    new->ucs[i] = preedit[i];
+	    new->utf8_len += im_hangul_ucs_to_utf8(preedit[i],
+						   new->utf8 + new->utf8_len);
 	}
+	new->len = i;
     }
+    new->ucs[new->len] = 0;
+    new->utf8[new->utf8_len] = '\0';
+
+    hic->preedit = new;
+
+    /* signal handler에서 preedit을 다시 바꿀 수도 있으므로
+     * 비교는 signal을 보내기 전에 모두 해둔다. */
+    started = old->len == 0 && new->len > 0;
+    changed = old->len != new->len ||
+	      memcmp(old->ucs, new->ucs, new->len * sizeof(ucschar)) != 0;
+    ended = old->len > 0 && new->len == 0;
+
+    if (changed)
+	hic->preedit_serial++;
 
-    if (old[0] == '\0' && hic->preedit->len > 0)
+    if (started)
 	g_signal_emit_by_name (hic, "preedit_start");
 
     // preedit string이 바뀌지 않았는데도 preedit changed signal을 너무 자주
     // 보내게 되면 오작동하는 프로그램이 있을 수 있다.
     // GtkHtml 같은 것은 backspace키를 처리하는 과정에서도 reset을 부르는데
     // 여기서 매번 preedit changed signal을 보내면 오작동한다.
-    if (strcmp(hic->preedit->str, old) != 0)
+    if (changed)
 	im_hangul_ic_emit_preedit_changed(hic);
 
-    if (old[0] != '\0' && hic->preedit->len == 0)
+    if (ended) {
+	im_hangul_ic_flush_preedit_changed(hic);
 	g_signal_emit_by_name (hic, "preedit_end");
+    }
+}
 
-    g_free(old);
+#if GTK_CHECK_VERSION(3, 8, 0)
+static void
+im_hangul_ic_on_frame_update (GdkFrameClock *clock, gpointer data)
+{
+  im_hangul_ic_flush_preedit_changed (GTK_IM_CONTEXT_HANGUL (data));
 }
 
-static inline void
+static GdkFrameClock*
+im_hangul_ic_get_frame_clock (GtkIMContextHangul *hcontext)
+{
+  GdkFrameClock *clock;
+
+  if (hcontext->frame_clock != NULL)
+    return hcontext->frame_clock;
+
+  if (hcontext->client_window == NULL)
+    return NULL;
+
+  clock = gdk_window_get_frame_clock (hcontext->client_window);
+  if (clock == NULL)
+    return NULL;
+
+  hcontext->frame_clock = g_object_ref (clock);
+  hcontext->frame_clock_handler =
+	g_signal_connect (clock, "update",
+			  G_CALLBACK (im_hangul_ic_on_frame_update), hcontext);
+  return clock;
+}
+
+static void
+im_hangul_ic_release_frame_clock (GtkIMContextHangul *hcontext)
+{
+  if (hcontext->frame_clock != NULL) {
+    g_signal_handler_disconnect (hcontext->frame_clock,
+				 hcontext->frame_clock_handler);
+    g_object_unref (hcontext->frame_clock);
+    hcontext->frame_clock = NULL;
+    hcontext->frame_clock_handler = 0;
+  }
+}
+#endif
+
+/* enable_preedit_coalescing이 켜져 있으면 preedit_changed를 바로 보내지 않고
+ * client window의 다음 frame에 한번만 보낸다. 빠르게 입력하거나 backspace를
+ * 누르고 있을 때 한 frame 안에 여러번 layout을 다시 하지 않도록 한다.
+ * commit, preedit_end 전에는 미뤄둔 preedit_changed를 먼저 보낸다. */
+static void
 im_hangul_ic_emit_preedit_changed (GtkIMContextHangul *hcontext)
 {
-  if (hcontext->use_preedit)
-    g_signal_emit_by_name (hcontext, "preedit_changed");
+  if (!hcontext->use_preedit)
+    return;
+
+#if GTK_CHECK_VERSION(3, 8, 0)
+  if (pref_use_preedit_coalescing) {
+    GdkFrameClock *clock = im_hangul_ic_get_frame_clock (hcontext);
+    if (clock != NULL) {
+      hcontext->preedit_changed_pending = TRUE;
+      gdk_frame_clock_request_phase (clock, GDK_FRAME_CLOCK_PHASE_UPDATE);
+      return;
+    }
+  }
+#endif
+
+  g_signal_emit_by_name (hcontext, "preedit_changed");
+}
+
+static void
+im_hangul_ic_flush_preedit_changed (GtkIMContextHangul *hcontext)
+{
+  if (hcontext->preedit_changed_pending) {
+    hcontext->preedit_changed_pending = FALSE;
+    g_signal_emit_by_name (hcontext, "preedit_changed");
+  }
+}
+
+static void
+im_hangul_ic_emit_commit (GtkIMContextHangul *hcontext, const char *str)
+{
+  im_hangul_ic_flush_preedit_changed (hcontext);
+  g_signal_emit_by_name (hcontext, "commit", str);
 }
 
 static void
@@ -1011,8 +2095,8 @@ im_hangul_ic_focus_out (GtkIMContext *context)
   hcontext = GTK_IM_CONTEXT_HANGUL(context);
   im_hangul_ic_hide_status_window (hcontext);
   im_hangul_set_input_mode_info (hcontext->client_window, INPUT_MODE_INFO_NONE);
-  if (current_focused_ic == context)
-    current_focused_ic = NULL;
+  if (hcontext->toplevel != NULL && hcontext->toplevel->focused == hcontext)
+    hcontext->toplevel->focused = NULL;
 }
 
 static void
@@ -1024,6 +2108,10 @@ im_hangul_ic_set_use_preedit (GtkIMContext *context, gboolean use_preedit)
 
   hcontext = GTK_IM_CONTEXT_HANGUL(context);
   hcontext->use_preedit = use_preedit;
+
+  /* the client does not want preedit_changed any more */
+  if (!use_preedit)
+    hcontext->preedit_changed_pending = FALSE;
 }
 
 static void
@@ -1045,48 +2133,48 @@ im_hangul_is_modifier (guint state)
   return ((state & GDK_CONTROL_MASK) || (state & GDK_MOD1_MASK));
 }
 
-static inline gboolean
-im_hangul_is_hangul_key (GdkEventKey *key)
-{
-    return im_hangul_accel_list_has_key(hangul_keys, key);
-}
-
-static inline gboolean
-im_hangul_is_hanja_key (GdkEventKey *key)
-{
-    return im_hangul_accel_list_has_key(hanja_keys, key);
-}
-
-static inline gboolean
-im_hangul_is_backspace (GdkEventKey *key)
-{
-  return (key->keyval == GDK_KEY_BackSpace);
-}
-
 static void
-im_hangul_ic_reset (GtkIMContext *context)
+im_hangul_ic_reset_real (GtkIMContext *context)
 {
     const ucschar* preedit;
     const ucschar* flush;
     GtkIMContextHangul *hic = GTK_IM_CONTEXT_HANGUL (context);
 
+    im_hangul_ic_flush_commit_batch(hic);
+
     flush = hangul_ic_flush(hic->hic);
 
     preedit = hangul_ic_get_preedit_string(hic->hic);
     im_hangul_ic_set_preedit(hic, preedit);
 
     if (flush[0] != 0) {
-	char* str = g_ucs4_to_utf8(flush, -1, NULL, NULL, NULL);
-	g_signal_emit_by_name(hic, "commit", str);
-	g_free(str);
+	char buf[IM_HANGUL_COMMIT_BUF_SIZE];
+	char* str = im_hangul_ucs4_to_utf8(flush, buf, sizeof(buf));
+	im_hangul_ic_emit_commit(hic, str);
+	if (str != buf)
+	    g_free(str);
+    }
+}
+
+static void
+im_hangul_ic_reset (GtkIMContext *context)
+{
+    guint64 start;
+
+    if (!(im_hangul_debug_flags & IM_HANGUL_DEBUG_LATENCY)) {
+	im_hangul_ic_reset_real(context);
+	return;
     }
+
+    start = im_hangul_debug_now();
+    im_hangul_ic_reset_real(context);
+    im_hangul_latency_record(LATENCY_RESET, start);
 }
 
 static gboolean
-im_hangul_handle_direct_mode (GtkIMContextHangul *hcontext,
-			      GdkEventKey *key)
+im_hangul_handle_direct_mode (GtkIMContextHangul *hcontext, guint accel)
 {
-    if (im_hangul_is_hangul_key (key)) {
+    if (accel & IM_HANGUL_ACCEL_HANGUL) {
 	im_hangul_ic_reset(GTK_IM_CONTEXT(hcontext));
 	im_hangul_set_input_mode(hcontext, INPUT_MODE_HANGUL);
 	return TRUE;
@@ -1145,169 +2233,6 @@ im_hangul_ic_retrieve_surrounding_by_slave (GtkIMContext *context, gpointer data
     return ret;
 }
 
-/* this is a very dangerous function:
- * safe only when GDKKEYSYMS's value is enumarated  */
-static guint
-im_hangul_dvorak_to_qwerty (guint code)
-{
-  /* maybe safe if we use switch statement */
-  static guint table[] = {
-    GDK_KEY_exclam,			/* GDK_KEY_exclam */
-    GDK_KEY_Q,			/* GDK_KEY_quotedbl */
-    GDK_KEY_numbersign,		/* GDK_KEY_numbersign */
-    GDK_KEY_dollar,			/* GDK_KEY_dollar */
-    GDK_KEY_percent,		/* GDK_KEY_percent */
-    GDK_KEY_ampersand,		/* GDK_KEY_ampersand */
-    GDK_KEY_q,			/* GDK_KEY_apostrophe */
-    GDK_KEY_parenleft,		/* GDK_KEY_parenleft */
-    GDK_KEY_parenright,		/* GDK_KEY_parenright */
-    GDK_KEY_asterisk,		/* GDK_KEY_asterisk */
-    GDK_KEY_braceright,		/* GDK_KEY_plus */
-    GDK_KEY_w,			/* GDK_KEY_comma */
-    GDK_KEY_apostrophe,		/* GDK_KEY_minus */
-    GDK_KEY_e,			/* GDK_KEY_period */
-    GDK_KEY_bracketleft,		/* GDK_KEY_slash */
-    GDK_KEY_0,			/* GDK_KEY_0 */
-    GDK_KEY_1,			/* GDK_KEY_1 */
-    GDK_KEY_2,			/* GDK_KEY_2 */
-    GDK_KEY_3,			/* GDK_KEY_3 */
-    GDK_KEY_4,			/* GDK_KEY_4 */
-    GDK_KEY_5,			/* GDK_KEY_5 */
-    GDK_KEY_6,			/* GDK_KEY_6 */
-    GDK_KEY_7,			/* GDK_KEY_7 */
-    GDK_KEY_8,			/* GDK_KEY_8 */
-    GDK_KEY_9,			/* GDK_KEY_9 */
-    GDK_KEY_Z,			/* GDK_KEY_colon */
-    GDK_KEY_z,			/* GDK_KEY_semicolon */
-    GDK_KEY_W,			/* GDK_KEY_less */
-    GDK_KEY_bracketright,		/* GDK_KEY_qual */
-    GDK_KEY_E,			/* GDK_KEY_greater */
-    GDK_KEY_braceleft,		/* GDK_KEY_question */
-    GDK_KEY_at,			/* GDK_KEY_at */
-    GDK_KEY_A,			/* GDK_KEY_A */
-    GDK_KEY_N,			/* GDK_KEY_B */
-    GDK_KEY_I,			/* GDK_KEY_C */
-    GDK_KEY_H,			/* GDK_KEY_D */
-    GDK_KEY_D,			/* GDK_KEY_E */
-    GDK_KEY_Y,			/* GDK_KEY_F */
-    GDK_KEY_U,			/* GDK_KEY_G */
-    GDK_KEY_J,			/* GDK_KEY_H */
-    GDK_KEY_G,			/* GDK_KEY_I */
-    GDK_KEY_C,			/* GDK_KEY_J */
-    GDK_KEY_V,			/* GDK_KEY_K */
-    GDK_KEY_P,			/* GDK_KEY_L */
-    GDK_KEY_M,			/* GDK_KEY_M */
-    GDK_KEY_L,			/* GDK_KEY_N */
-    GDK_KEY_S,			/* GDK_KEY_O */
-    GDK_KEY_R,			/* GDK_KEY_P */
-    GDK_KEY_X,			/* GDK_KEY_Q */
-    GDK_KEY_O,			/* GDK_KEY_R */
-    GDK_KEY_colon,			/* GDK_KEY_S */
-    GDK_KEY_K,			/* GDK_KEY_T */
-    GDK_KEY_F,			/* GDK_KEY_U */
-    GDK_KEY_greater,		/* GDK_KEY_V */
-    GDK_KEY_less,			/* GDK_KEY_W */
-    GDK_KEY_B,			/* GDK_KEY_X */
-    GDK_KEY_T,			/* GDK_KEY_Y */
-    GDK_KEY_question,		/* GDK_KEY_Z */
-    GDK_KEY_minus,			/* GDK_KEY_bracketleft */
-    GDK_KEY_backslash,		/* GDK_KEY_backslash */
-    GDK_KEY_equal,			/* GDK_KEY_bracketright */
-    GDK_KEY_asciicircum,		/* GDK_KEY_asciicircum */
-    GDK_KEY_quotedbl,		/* GDK_KEY_underscore */
-    GDK_KEY_grave,			/* GDK_KEY_grave */
-    GDK_KEY_a,			/* GDK_KEY_a */
-    GDK_KEY_n,			/* GDK_KEY_b */
-    GDK_KEY_i,			/* GDK_KEY_c */
-    GDK_KEY_h,			/* GDK_KEY_d */
-    GDK_KEY_d,			/* GDK_KEY_e */
-    GDK_KEY_y,			/* GDK_KEY_f */
-    GDK_KEY_u,			/* GDK_KEY_g */
-    GDK_KEY_j,			/* GDK_KEY_h */
-    GDK_KEY_g,			/* GDK_KEY_i */
-    GDK_KEY_c,			/* GDK_KEY_j */
-    GDK_KEY_v,			/* GDK_KEY_k */
-    GDK_KEY_p,			/* GDK_KEY_l */
-    GDK_KEY_m,			/* GDK_KEY_m */
-    GDK_KEY_l,			/* GDK_KEY_n */
-    GDK_KEY_s,			/* GDK_KEY_o */
-    GDK_KEY_r,			/* GDK_KEY_p */
-    GDK_KEY_x,			/* GDK_KEY_q */
-    GDK_KEY_o,			/* GDK_KEY_r */
-    GDK_KEY_semicolon,		/* GDK_KEY_s */
-    GDK_KEY_k,			/* GDK_KEY_t */
-    GDK_KEY_f,			/* GDK_KEY_u */
-    GDK_KEY_period,			/* GDK_KEY_v */
-    GDK_KEY_comma,			/* GDK_KEY_w */
-    GDK_KEY_b,			/* GDK_KEY_x */
-    GDK_KEY_t,			/* GDK_KEY_y */
-    GDK_KEY_slash,			/* GDK_KEY_z */
-    GDK_KEY_underscore,		/* GDK_KEY_braceleft */
-    GDK_KEY_bar,			/* GDK_KEY_bar */
-    GDK_KEY_plus,			/* GDK_KEY_braceright */
-    GDK_KEY_asciitilde,		/* GDK_KEY_asciitilde */
-  };
-
-  if (code < GDK_KEY_exclam || code > GDK_KEY_asciitilde)
-    return code;
-  return table[code - GDK_KEY_exclam];
-}
-
-static const guint keymap[][2] = {
-    { GDK_KEY_1,             GDK_KEY_exclam         },  /* 10 */
-    { GDK_KEY_2,             GDK_KEY_at             },  /* 11 */
-    { GDK_KEY_3,             GDK_KEY_numbersign     },  /* 12 */
-    { GDK_KEY_4,             GDK_KEY_dollar         },  /* 13 */
-    { GDK_KEY_5,             GDK_KEY_percent        },  /* 14 */
-    { GDK_KEY_6,             GDK_KEY_asciicircum    },  /* 15 */
-    { GDK_KEY_7,             GDK_KEY_ampersand      },  /* 16 */
-    { GDK_KEY_8,             GDK_KEY_asterisk       },  /* 17 */
-    { GDK_KEY_9,             GDK_KEY_parenleft      },  /* 18 */
-    { GDK_KEY_0,             GDK_KEY_parenright     },  /* 19 */
-    { GDK_KEY_minus,         GDK_KEY_underscore     },  /* 20 */
-    { GDK_KEY_equal,         GDK_KEY_plus           },  /* 21 */
-    { GDK_KEY_BackSpace,     GDK_KEY_BackSpace      },  /* 22 */
-    { GDK_KEY_Tab,           GDK_KEY_Tab            },  /* 23 */
-    { GDK_KEY_q,             GDK_KEY_Q              },  /* 24 */
-    { GDK_KEY_w,             GDK_KEY_W              },  /* 25 */
-    { GDK_KEY_e,             GDK_KEY_E              },  /* 26 */
-    { GDK_KEY_r,             GDK_KEY_R              },  /* 27 */
-    { GDK_KEY_t,             GDK_KEY_T              },  /* 28 */
-    { GDK_KEY_y,             GDK_KEY_Y              },  /* 29 */
-    { GDK_KEY_u,             GDK_KEY_U              },  /* 30 */
-    { GDK_KEY_i,             GDK_KEY_I              },  /* 31 */
-    { GDK_KEY_o,             GDK_KEY_O              },  /* 32 */
-    { GDK_KEY_p,             GDK_KEY_P              },  /* 33 */
-    { GDK_KEY_bracketleft,   GDK_KEY_braceleft      },  /* 34 */
-    { GDK_KEY_bracketright,  GDK_KEY_braceright     },  /* 35 */
-    { GDK_KEY_Return,        GDK_KEY_Return         },  /* 36 */
-    { GDK_KEY_Control_L,     GDK_KEY_Control_L      },  /* 37 */
-    { GDK_KEY_a,             GDK_KEY_A              },  /* 38 */
-    { GDK_KEY_s,             GDK_KEY_S              },  /* 39 */
-    { GDK_KEY_d,             GDK_KEY_D              },  /* 40 */
-    { GDK_KEY_f,             GDK_KEY_F              },  /* 41 */
-    { GDK_KEY_g,             GDK_KEY_G              },  /* 42 */
-    { GDK_KEY_h,             GDK_KEY_H              },  /* 43 */
-    { GDK_KEY_j,             GDK_KEY_J              },  /* 44 */
-    { GDK_KEY_k,             GDK_KEY_K              },  /* 45 */
-    { GDK_KEY_l,             GDK_KEY_L              },  /* 46 */
-    { GDK_KEY_semicolon,     GDK_KEY_colon          },  /* 47 */
-    { GDK_KEY_apostrophe,    GDK_KEY_quotedbl       },  /* 48 */
-    { GDK_KEY_grave,         GDK_KEY_asciitilde     },  /* 49 */
-    { GDK_KEY_Shift_L,       GDK_KEY_Shift_L        },  /* 50 */
-    { GDK_KEY_backslash,     GDK_KEY_bar            },  /* 51 */
-    { GDK_KEY_z,             GDK_KEY_Z              },  /* 52 */
-    { GDK_KEY_x,             GDK_KEY_X              },  /* 53 */
-    { GDK_KEY_c,             GDK_KEY_C              },  /* 54 */
-    { GDK_KEY_v,             GDK_KEY_V              },  /* 55 */
-    { GDK_KEY_b,             GDK_KEY_B              },  /* 56 */
-    { GDK_KEY_n,             GDK_KEY_N              },  /* 57 */
-    { GDK_KEY_m,             GDK_KEY_M              },  /* 58 */
-    { GDK_KEY_comma,         GDK_KEY_less           },  /* 59 */
-    { GDK_KEY_period,        GDK_KEY_greater        },  /* 60 */
-    { GDK_KEY_slash,         GDK_KEY_question       },  /* 61 */
-};
-
 /* 한글 입력기는 각 키의 위치에 따라서 입력되는 자모가 결정되어 있다. 
  * 그래서 키보드를 드보락이라든가, 유럽언어로 바꾸게 되면 각 키가 생성하는
  * 라틴문자가 qwerty와 달라지게 된다. 그 상태에서 keyval을 그대로 사용하면
@@ -1333,11 +2258,11 @@ im_hangul_get_keyval(GtkIMContextHangul *hcontext,
 	return keyval & 0x0000ffff;
 
     if (pref_use_system_keymap) {
-	/* treat for dvorak */
-	if (pref_use_dvorak)
-	    keyval = im_hangul_dvorak_to_qwerty (keyval);
-
 	if (keyval >= GDK_KEY_exclam && keyval <= GDK_KEY_asciitilde) {
+	    /* treat for dvorak, colemak, ... */
+	    keyval = im_hangul_latin_layout_to_qwerty[pref_latin_layout]
+			[keyval - IM_HANGUL_LATIN_LAYOUT_FIRST];
+
 	    /* treat capslock, as capslock is not on */
 	    if (state & GDK_LOCK_MASK) {
 		if (state & GDK_SHIFT_MASK) {
@@ -1350,13 +2275,11 @@ im_hangul_get_keyval(GtkIMContextHangul *hcontext,
 	    }
 	}
     } else {
-	/* keycode가 10에서 61 범위에 있으면 내장 keymap을 이용해서 변환한다. */
-	if (keycode >= 10 && keycode <= 61) {
-	    if (state & GDK_SHIFT_MASK) {
-		keyval = keymap[keycode - 10][1];
-	    } else {
-		keyval = keymap[keycode - 10][0];
-	    }
+	/* 내장 keymap에 있는 keycode이면 keymap을 이용해서 변환한다. */
+	if (keycode <= IM_HANGUL_KEYCODE_MAX) {
+	    guint level = (state & GDK_SHIFT_MASK) ? 1 : 0;
+	    if (im_hangul_keycode_table[keycode][level] != 0)
+		keyval = im_hangul_keycode_table[keycode][level];
 	}
     }
 
@@ -1413,7 +2336,7 @@ im_hangul_candidate_commit(GtkIMContextHangul *ic,
 	    gtk_im_context_delete_surrounding(GTK_IM_CONTEXT(ic), -len, len);
 	}
 
-	g_signal_emit_by_name(ic, "commit", value);
+	im_hangul_ic_emit_commit(ic, value);
 	close_candidate_window(ic);
     }
 }
@@ -1489,17 +2412,174 @@ im_hangul_ic_slave_filter_keypress (GtkIMContext *context, GdkEventKey *key)
   g_return_val_if_fail (key != NULL, FALSE);
 
   hcontext = GTK_IM_CONTEXT_HANGUL(context);
+
+  /* The key press has not been to the toplevel key handler of the
+   * context. This is the case of a key forwarded from another toplevel,
+   * like the popup of GtkEntryCompletion, which holds the keyboard grab
+   * and gives the keys to the entry with gtk_widget_event(). */
+  if (key->type == GDK_KEY_PRESS &&
+      (key->time != hcontext->filtered_key_time ||
+       key->hardware_keycode != hcontext->filtered_key_code ||
+       key->keyval != hcontext->filtered_keyval)) {
+    if (gtk_im_context_hangul_filter_keypress(hcontext, key))
+      return TRUE;
+  }
+
   return gtk_im_context_filter_keypress(hcontext->slave, key);
 }
 
-/* use hangul composer */
+/* commit batching
+ * enable_commit_batching이 켜져 있고 프로그램이 바빠서 키 이벤트가 밀려 
+ * 있으면, 밀린 키를 처리하는 동안 commit string을 모아 두고 preedit도 
+ * 알리지 않는다. 밀린 키를 다 처리하면 한번에 commit하고 preedit을 
+ * 알려서 프로그램이 한번만 화면을 다시 그리게 한다.
+ * commit 외에 다른 처리를 하기 전에는 모아둔 것을 먼저 보낸다.
+ * 모아둔 것은 다음에 화면을 그리기 전에 보낸다. */
 static gboolean
-im_hangul_ic_filter_keypress (GtkIMContext *context, GdkEventKey *key)
+im_hangul_key_event_pending (void)
+{
+  GdkEvent *event;
+  gboolean res = FALSE;
+
+  /* gdk_events_pending()은 마우스 움직임 같은 다른 이벤트에도 TRUE이므로
+   * 큐의 다음 이벤트가 키 이벤트인지 본다 */
+  event = gdk_event_peek ();
+  if (event != NULL) {
+    res = event->type == GDK_KEY_PRESS || event->type == GDK_KEY_RELEASE;
+    gdk_event_free (event);
+  }
+
+  return res;
+}
+
+static void
+im_hangul_ic_commit_batch_append (GtkIMContextHangul *hcontext,
+				  const ucschar *commit)
+{
+  if (hcontext->commit_batch == NULL)
+    hcontext->commit_batch = g_string_new (NULL);
+
+  if (commit[0] != 0) {
+    char buf[IM_HANGUL_COMMIT_BUF_SIZE];
+    char* str = im_hangul_ucs4_to_utf8(commit, buf, sizeof(buf));
+    g_string_append (hcontext->commit_batch, str);
+    if (str != buf)
+      g_free(str);
+  }
+
+  hcontext->commit_batching = TRUE;
+}
+
+static void
+im_hangul_ic_flush_commit_batch (GtkIMContextHangul *hcontext)
+{
+  const ucschar* preedit;
+
+  if (hcontext->commit_batch_idle != 0) {
+    g_source_remove (hcontext->commit_batch_idle);
+    hcontext->commit_batch_idle = 0;
+  }
+
+  if (!hcontext->commit_batching)
+    return;
+  hcontext->commit_batching = FALSE;
+
+  if (hcontext->commit_batch->len > 0) {
+    /* see im_hangul_ic_filter_process() */
+    if (pref_clear_preedit_on_commit)
+      im_hangul_ic_set_preedit(hcontext, NULL);
+    im_hangul_ic_emit_commit (hcontext, hcontext->commit_batch->str);
+    g_string_truncate (hcontext->commit_batch, 0);
+  }
+
+  preedit = hangul_ic_get_preedit_string(hcontext->hic);
+  im_hangul_ic_set_preedit(hcontext, preedit);
+}
+
+static gboolean
+im_hangul_ic_commit_batch_on_idle (gpointer data)
+{
+  GtkIMContextHangul *hcontext = GTK_IM_CONTEXT_HANGUL (data);
+
+  hcontext->commit_batch_idle = 0;
+  im_hangul_ic_flush_commit_batch (hcontext);
+  return FALSE;
+}
+
+static gboolean
+im_hangul_ic_filter_backspace (GtkIMContextHangul *hcontext)
+{
+  bool res;
+  const ucschar* preedit;
+
+  im_hangul_ic_flush_commit_batch (hcontext);
+
+  res = hangul_ic_backspace(hcontext->hic);
+  if (res) {
+      preedit = hangul_ic_get_preedit_string(hcontext->hic);
+      im_hangul_ic_set_preedit(hcontext, preedit);
+  }
+  return res;
+}
+
+static gboolean
+im_hangul_ic_filter_process (GtkIMContextHangul *hcontext, GdkEventKey *key)
 {
   int keyval;
   bool res;
   const ucschar* commit;
   const ucschar* preedit;
+
+  keyval = im_hangul_get_keyval(hcontext,
+			     key->hardware_keycode, key->keyval, key->state);
+  res = hangul_ic_process(hcontext->hic, keyval);
+
+  commit = hangul_ic_get_commit_string(hcontext->hic);
+
+  if (pref_use_commit_batching) {
+      im_hangul_ic_commit_batch_append (hcontext, commit);
+      if (res && im_hangul_key_event_pending()) {
+	  if (hcontext->commit_batch_idle == 0)
+	      hcontext->commit_batch_idle =
+		  g_idle_add_full (GDK_PRIORITY_REDRAW - 1,
+				   im_hangul_ic_commit_batch_on_idle,
+				   hcontext, NULL);
+	  return res;
+      }
+      im_hangul_ic_flush_commit_batch (hcontext);
+      return res;
+  }
+
+  if (commit[0] != 0) {
+      char buf[IM_HANGUL_COMMIT_BUF_SIZE];
+      char* str = im_hangul_ucs4_to_utf8(commit, buf, sizeof(buf));
+      /* 몇몇 어플리케이션에서 입력기 관련 구현에 버그가 있어서
+       * commit하기 전에 preedit string을 빈 스트링으로 만들지 
+       * 않으면 오작동하는 경우가 있다. 이 문제를 피하기 위해서
+       * clear_preedit_apps에 있는 어플리케이션에서는
+       * commit하기 전에 preedit string을 빈 스트링으로 만든다.
+       * 그 외에는 preedit-end, preedit-start 시그널 없이 commit하고
+       * 바뀐 preedit string만 알린다. 시그널마다 큰 GtkTextView는 
+       * layout을 다시 하게 된다. */
+      if (pref_clear_preedit_on_commit)
+	  im_hangul_ic_set_preedit(hcontext, NULL);
+      im_hangul_ic_emit_commit (hcontext, str);
+      if (str != buf)
+	  g_free(str);
+  }
+
+  preedit = hangul_ic_get_preedit_string(hcontext->hic);
+  im_hangul_ic_set_preedit(hcontext, preedit);
+
+  return res;
+}
+
+/* use hangul composer */
+static gboolean
+im_hangul_ic_filter_keypress_real (GtkIMContext *context, GdkEventKey *key)
+{
+  guint key_class;
+  guint accel;
   GtkIMContextHangul *hcontext;
 
   g_return_val_if_fail (context != NULL, FALSE);
@@ -1512,12 +2592,18 @@ im_hangul_ic_filter_keypress (GtkIMContext *context, GdkEventKey *key)
     return FALSE;
   }
 
+  /* password, number, ... fields: the slave takes all keys */
+  if (hcontext->passthrough)
+    return FALSE;
+
   /* ignore key release */
   if (key->type == GDK_KEY_RELEASE)
     return FALSE;
 
+  key_class = im_hangul_key_class(key->keyval);
+
   /* we silently ignore shift keys */
-  if (key->keyval == GDK_KEY_Shift_L || key->keyval == GDK_KEY_Shift_R)
+  if (key_class & IM_HANGUL_KEY_SHIFT)
     return FALSE;
 
   /* candidate window mode */
@@ -1526,18 +2612,24 @@ im_hangul_ic_filter_keypress (GtkIMContext *context, GdkEventKey *key)
 
   /* on capslock, we use Hangul Jamo */
   if (pref_use_capslock) {
-      if (key->state & GDK_LOCK_MASK)
-	  hangul_ic_set_output_mode(hcontext->hic, HANGUL_OUTPUT_JAMO);
-      else
-	  hangul_ic_set_output_mode(hcontext->hic, HANGUL_OUTPUT_SYLLABLE);
+      gboolean jamo = (key->state & GDK_LOCK_MASK) != 0;
+      if (jamo != hcontext->output_jamo) {
+	  hangul_ic_set_output_mode(hcontext->hic,
+		  jamo ? HANGUL_OUTPUT_JAMO : HANGUL_OUTPUT_SYLLABLE);
+	  hcontext->output_jamo = jamo;
+      }
   }
 
+  accel = 0;
+  if (key_class & IM_HANGUL_KEY_ACCEL)
+    accel = im_hangul_accel_table_lookup(key);
+
   /* handle direct mode */
   if (im_hangul_ic_get_toplevel_input_mode(hcontext) == INPUT_MODE_DIRECT)
-    return im_hangul_handle_direct_mode (hcontext, key);
+    return im_hangul_handle_direct_mode (hcontext, accel);
 
   /* handle Escape key: automaticaly change to direct mode */
-  if (key->keyval == GDK_KEY_Escape)
+  if (key_class & IM_HANGUL_KEY_ESCAPE)
     {
       im_hangul_ic_reset(context);
       im_hangul_set_input_mode(hcontext, INPUT_MODE_DIRECT);
@@ -1552,48 +2644,44 @@ im_hangul_ic_filter_keypress (GtkIMContext *context, GdkEventKey *key)
     }
 
   /* hanja key */
-  if (im_hangul_is_hanja_key(key))
+  if (accel & IM_HANGUL_ACCEL_HANJA)
     {
       popup_candidate_window (hcontext);
       return TRUE;
     }
 
   /* hangul key: mode change to direct mode */
-  if (im_hangul_is_hangul_key(key)) {
+  if (accel & IM_HANGUL_ACCEL_HANGUL) {
       im_hangul_ic_reset(context);
       im_hangul_set_input_mode(hcontext, INPUT_MODE_DIRECT);
       return TRUE;
   }
 
   /* backspace */
-  if (im_hangul_is_backspace(key)) {
-      res = hangul_ic_backspace(hcontext->hic);
-      if (res) {
-	  preedit = hangul_ic_get_preedit_string(hcontext->hic);
-	  im_hangul_ic_set_preedit(hcontext, preedit);
-      }
-      return res;
-  }
+  if (key_class & IM_HANGUL_KEY_BACKSPACE)
+    return im_hangul_ic_filter_backspace (hcontext);
 
   /* process */
-  keyval = im_hangul_get_keyval(hcontext,
-			     key->hardware_keycode, key->keyval, key->state);
-  res = hangul_ic_process(hcontext->hic, keyval);
+  return im_hangul_ic_filter_process (hcontext, key);
+}
 
-  commit = hangul_ic_get_commit_string(hcontext->hic);
-  if (commit[0] != 0) {
-      char* str = g_ucs4_to_utf8(commit, -1, NULL, NULL, NULL);
-      /* 몇몇 어플리케이션에서 입력기 관련 구현에 버그가 있어서
-       * commit하기 전에 preedit string을 빈 스트링으로 만들지 
-       * 않으면 오작동하는 경우가 있다. 이 문제를 피하기 위해서
-       * commit하기 전에 preedit string을 빈 스트링으로 만든다. */
-      im_hangul_ic_set_preedit(hcontext, NULL);
-      g_signal_emit_by_name (hcontext, "commit", str);
-      g_free(str);
-  }
+static gboolean
+im_hangul_ic_filter_keypress (GtkIMContext *context, GdkEventKey *key)
+{
+  guint64 start;
+  guint64 emissions;
+  gboolean res;
 
-  preedit = hangul_ic_get_preedit_string(hcontext->hic);
-  im_hangul_ic_set_preedit(hcontext, preedit);
+  if (im_hangul_debug_flags == 0)
+    return im_hangul_ic_filter_keypress_real(context, key);
+
+  emissions = signal_emissions;
+  start = im_hangul_debug_now();
+  res = im_hangul_ic_filter_keypress_real(context, key);
+  if (im_hangul_debug_flags & IM_HANGUL_DEBUG_LATENCY)
+    im_hangul_latency_record(LATENCY_FILTER_KEYPRESS, start);
+  if (im_hangul_debug_flags & IM_HANGUL_DEBUG_SIGNALS)
+    im_hangul_signal_record_keypress(signal_emissions - emissions);
 
   return res;
 }
@@ -1665,11 +2753,15 @@ im_hangul_ic_show_status_window (GtkIMContextHangul *hcontext)
 
     if (pref_use_status_window && hcontext->toplevel != NULL) {
 	if (hcontext->toplevel->status == NULL) {
+	    gint64 mark = im_hangul_memory_mark();
 	    hcontext->toplevel->status =
 		status_window_new(hcontext->toplevel->widget);
+	    im_hangul_memory_created(MEMORY_STATUS_WINDOW,
+				     im_hangul_memory_mark() - mark);
 	}
 
-	im_hangul_ic_update_status_window_position(hcontext);
+	/* 숨어 있는 동안에는 옮기지 않으므로 보이기 전에 바로 옮긴다 */
+	toplevel_move_status_window(hcontext->toplevel, hcontext);
 	gtk_widget_show (hcontext->toplevel->status);
     }
 }
@@ -1685,34 +2777,37 @@ im_hangul_ic_hide_status_window (GtkIMContextHangul *hcontext)
 }
 
 static void
-im_hangul_ic_update_status_window_position (GtkIMContextHangul* hic)
+im_hangul_ic_get_status_window_position (GtkIMContextHangul* hic,
+					 gint *x, gint *y)
 {
-    int x = 0;
-    int y = 0;
+    int height = 0;
+
+    toplevel_get_window_geometry (hic->toplevel, hic->client_window,
+				  x, y, &height);
+
+    if (hic->cursor.x < 0) {
+	/* show status window below client window
+	 * if the cursor position is not updated */
+	*y += height + 3;
+    } else {
+	*x += hic->cursor.x + 3;
+	*y += hic->cursor.y + hic->cursor.height + 3;
+    }
+}
 
+static void
+im_hangul_ic_update_status_window_position (GtkIMContextHangul* hic)
+{
     if (hic == NULL)
 	return;
 
     if (hic->client_window == NULL)
 	return;
 
-    if (hic->toplevel == NULL || hic->toplevel->status == NULL)
+    if (hic->toplevel == NULL)
 	return;
 
-    gdk_window_get_origin (hic->client_window, &x, &y);
-
-    if (hic->cursor.x < 0) {
-	/* show status window below client window
-	 * if the cursor position is not updated */
-	int height = 0;
-	height = gdk_window_get_height(hic->client_window);
-	y += height + 3;
-    } else {
-	x += hic->cursor.x + 3;
-	y += hic->cursor.y + hic->cursor.height + 3;
-    }
-
-    gtk_window_move (GTK_WINDOW(hic->toplevel->status), x, y);
+    toplevel_queue_status_window_move (hic->toplevel, hic);
 }
 
 static void
@@ -1729,13 +2824,99 @@ toplevel_on_configure_event(GtkWidget *widget,
 			 GdkEventConfigure *event,
 			 Toplevel *toplevel)
 {
-    if (current_focused_ic != NULL) {
-	GtkIMContextHangul* hic = GTK_IM_CONTEXT_HANGUL(current_focused_ic);
-	im_hangul_ic_update_status_window_position (hic);
-    }
+    /* the client windows move with the toplevel */
+    toplevel->geometry_window = NULL;
+
+    toplevel_queue_status_window_move (toplevel, toplevel->focused);
     return FALSE;
 }
 
+/* catch the keys before the widget getting it
+ * this is work around code for the problem:
+ *   http://bugzilla.gnome.org/show_bug.cgi?id=62948
+ * Some keys like return, tab, ':' is usually used for auto completion or
+ * commiting some changes. Some application programmers make the program
+ * catch the key before the im module getting the key and check that it is 
+ * return or tab or so. Then the program get the string from the text entry
+ * or textview, so there is no chance for im module to commit the current
+ * string. So in this case, we catch it first and process the filter
+ * function of the input context. Then mostly imhangul will work fine,
+ * I think :)
+ * We used to install a key snooper for this, which ran for every key event
+ * of the process. Now an emission hook of key-press-event does it for the
+ * toplevels which have a hangul context. The hook runs before all the
+ * handlers, so before the ones the application has put on its window.
+ * A hook can not stop the emission, so the result is kept in the toplevel
+ * and the handler of the toplevel returns it, before the default handler
+ * of the window activates the accelerators and passes the key to the
+ * focus widget. The keys which do not come through the toplevel are
+ * processed in im_hangul_ic_slave_filter_keypress(). */
+static gboolean
+toplevel_key_press_hook(GSignalInvocationHint *ihint,
+			guint n_param_values,
+			const GValue *param_values,
+			gpointer data)
+{
+    GObject *instance = g_value_get_object(&param_values[0]);
+    GdkEvent *event = g_value_get_boxed(&param_values[1]);
+    Toplevel *toplevel;
+
+    toplevel = g_object_get_data(instance, "gtk-imhangul-toplevel-info");
+    if (toplevel == NULL || toplevel->focused == NULL)
+	return TRUE;
+
+    if (event == NULL || event->type != GDK_KEY_PRESS)
+	return TRUE;
+
+    toplevel->hooked_event = &event->key;
+    toplevel->hooked_result =
+	gtk_im_context_hangul_filter_keypress(toplevel->focused, &event->key);
+
+    return TRUE;
+}
+
+static gboolean
+toplevel_on_key_press_event(GtkWidget *widget,
+			    GdkEventKey *event,
+			    Toplevel *toplevel)
+{
+    gboolean res;
+
+    if (event != toplevel->hooked_event)
+	return FALSE;
+
+    res = toplevel->hooked_result;
+    toplevel->hooked_event = NULL;
+    toplevel->hooked_result = FALSE;
+
+    return res;
+}
+
+static void
+toplevel_key_press_hook_add(void)
+{
+    /* the signal exists after the class is initialized */
+    key_press_widget_class = g_type_class_ref(GTK_TYPE_WIDGET);
+    key_press_signal_id = g_signal_lookup("key-press-event", GTK_TYPE_WIDGET);
+    key_press_hook_id = g_signal_add_emission_hook(key_press_signal_id, 0,
+					   toplevel_key_press_hook,
+					   NULL, NULL);
+}
+
+static void
+toplevel_key_press_hook_remove(void)
+{
+    if (key_press_hook_id != 0) {
+	g_signal_remove_emission_hook(key_press_signal_id, key_press_hook_id);
+	key_press_hook_id = 0;
+    }
+
+    if (key_press_widget_class != NULL) {
+	g_type_class_unref(key_press_widget_class);
+	key_press_widget_class = NULL;
+    }
+}
+
 static Toplevel *
 toplevel_new(GtkWidget *toplevel_widget)
 {
@@ -1746,12 +2927,25 @@ toplevel_new(GtkWidget *toplevel_widget)
   toplevel->widget = toplevel_widget;
   toplevel->status = NULL;
   toplevel->contexts = NULL;
+  toplevel->focused = NULL;
+  toplevel->hooked_event = NULL;
+  toplevel->hooked_result = FALSE;
+  toplevel->geometry_window = NULL;
+  toplevel->geometry_x = 0;
+  toplevel->geometry_y = 0;
+  toplevel->geometry_height = 0;
+  toplevel->status_x = G_MININT;
+  toplevel->status_y = G_MININT;
+  toplevel->status_tick_id = 0;
   toplevel->destroy_handler_id = 
 	    g_signal_connect_swapped (G_OBJECT(toplevel->widget), "destroy",
 			     G_CALLBACK(toplevel_destroy), toplevel);
   toplevel->configure_handler_id = 
 	    g_signal_connect (G_OBJECT(toplevel->widget), "configure-event",
-			     G_CALLBACK(toplevel_on_configure_event), NULL);
+			     G_CALLBACK(toplevel_on_configure_event), toplevel);
+  toplevel->key_press_handler_id = 
+	    g_signal_connect (G_OBJECT(toplevel->widget), "key-press-event",
+			     G_CALLBACK(toplevel_on_key_press_event), toplevel);
 
   g_object_set_data(G_OBJECT(toplevel_widget),
 		     "gtk-imhangul-toplevel-info", toplevel);
@@ -1786,6 +2980,99 @@ toplevel_remove_context(Toplevel *toplevel, GtkIMContextHangul *context)
     return;
 
   toplevel->contexts = g_slist_remove(toplevel->contexts, context);
+  if (toplevel->focused == context)
+    toplevel->focused = NULL;
+  /* the window may be destroyed and another one made at the same address */
+  if (toplevel->geometry_window == context->client_window)
+    toplevel->geometry_window = NULL;
+}
+
+/* gdk_window_get_origin() is a round trip to the X server, and the position
+ * of the status window is updated on every cursor move. So we keep the
+ * geometry of the last client window here. The cache is cleared by the
+ * configure event of the toplevel and by size-allocate of the client
+ * widget. */
+static void
+toplevel_get_window_geometry(Toplevel *toplevel, GdkWindow *window,
+			     gint *x, gint *y, gint *height)
+{
+  if (toplevel == NULL) {
+    gdk_window_get_origin(window, x, y);
+    *height = gdk_window_get_height(window);
+    return;
+  }
+
+  if (toplevel->geometry_window != window) {
+    gdk_window_get_origin(window, &toplevel->geometry_x, &toplevel->geometry_y);
+    toplevel->geometry_height = gdk_window_get_height(window);
+    toplevel->geometry_window = window;
+  }
+
+  *x = toplevel->geometry_x;
+  *y = toplevel->geometry_y;
+  *height = toplevel->geometry_height;
+}
+
+static void
+toplevel_move_status_window(Toplevel *toplevel, GtkIMContextHangul *hcontext)
+{
+  gint x = 0;
+  gint y = 0;
+
+  if (toplevel->status == NULL)
+    return;
+
+  if (hcontext == NULL || hcontext->client_window == NULL)
+    return;
+
+  im_hangul_ic_get_status_window_position(hcontext, &x, &y);
+  if (x == toplevel->status_x && y == toplevel->status_y)
+    return;
+
+  toplevel->status_x = x;
+  toplevel->status_y = y;
+  gtk_window_move(GTK_WINDOW(toplevel->status), x, y);
+}
+
+#if GTK_CHECK_VERSION(3, 8, 0)
+static gboolean
+toplevel_on_status_tick(GtkWidget *widget, GdkFrameClock *clock,
+			gpointer data)
+{
+  Toplevel *toplevel = data;
+
+  toplevel->status_tick_id = 0;
+  if (gtk_widget_get_visible(toplevel->status))
+    toplevel_move_status_window(toplevel, toplevel->focused);
+  return FALSE;
+}
+#endif
+
+/* The cursor location is set after almost every key, and the toplevel gets
+ * many configure events while it is dragged. So the status window is not
+ * moved at once: the position is worked out once on the next frame of the
+ * toplevel, for the focused context, and the window is moved only if the
+ * position has changed. A hidden status window is left alone, it is moved
+ * when it is shown. */
+static void
+toplevel_queue_status_window_move(Toplevel *toplevel,
+				  GtkIMContextHangul *hcontext)
+{
+  if (toplevel->status == NULL || !gtk_widget_get_visible(toplevel->status))
+    return;
+
+#if GTK_CHECK_VERSION(3, 8, 0)
+  if (gtk_widget_get_realized(toplevel->widget)) {
+    if (toplevel->status_tick_id == 0)
+      toplevel->status_tick_id =
+	    gtk_widget_add_tick_callback(toplevel->widget,
+					 toplevel_on_status_tick,
+					 toplevel, NULL);
+    return;
+  }
+#endif
+
+  toplevel_move_status_window(toplevel, hcontext);
 }
 
 static void
@@ -1803,6 +3090,7 @@ toplevel_delete(Toplevel *toplevel)
   if (toplevel != NULL) {
     if (toplevel->status != NULL) {
       gtk_widget_destroy(toplevel->status);
+      im_hangul_memory_destroyed(MEMORY_STATUS_WINDOW);
     }
     if (toplevel->contexts != NULL) {
       GSList *item = toplevel->contexts;
@@ -1813,6 +3101,13 @@ toplevel_delete(Toplevel *toplevel)
       }
       g_slist_free(toplevel->contexts);
     }
+#if GTK_CHECK_VERSION(3, 8, 0)
+    if (toplevel->status_tick_id != 0)
+      gtk_widget_remove_tick_callback (toplevel->widget,
+				       toplevel->status_tick_id);
+#endif
+    g_signal_handler_disconnect (toplevel->widget,
+				 toplevel->key_press_handler_id);
     g_signal_handler_disconnect (toplevel->widget,
 				 toplevel->configure_handler_id);
     g_signal_handler_disconnect (toplevel->widget,
@@ -1897,6 +3192,8 @@ im_hangul_get_candidate_string(GtkIMContextHangul *ic)
 	if (ic->candidate_string == NULL) {
 	    ic->candidate_string = g_array_sized_new(FALSE, FALSE,
 						     sizeof(gunichar), len);
+	    im_hangul_memory_created(MEMORY_CANDIDATE_STRING,
+				     sizeof(GArray) + len * sizeof(gunichar));
 	} else if (ic->candidate_string->len > 0) {
 	    g_array_set_size(ic->candidate_string, 0);
 	}
@@ -1912,67 +3209,83 @@ im_hangul_get_candidate_string(GtkIMContextHangul *ic)
 }
 
 static void
-popup_candidate_window (GtkIMContextHangul *hcontext)
+popup_candidate_window_real (GtkIMContextHangul *hcontext)
 {
   char* key;
   HanjaList* list;
+  gint64 mark;
+
+  im_hangul_ic_flush_commit_batch(hcontext);
 
   if (hcontext->candidate != NULL)
     {
       close_candidate_window(hcontext);
     }
 
-  if (hanja_table == NULL)
+  if (hanja_table == NULL) {
+      mark = im_hangul_memory_mark();
       hanja_table = hanja_table_load(NULL);
+      if (hanja_table != NULL)
+	  im_hangul_memory_created(MEMORY_HANJA_TABLE,
+				   im_hangul_memory_mark() - mark);
+  }
 
   key = im_hangul_get_candidate_string(hcontext);
   list = hanja_table_match_suffix(hanja_table, key);
   if (list != NULL) {
+      mark = im_hangul_memory_mark();
       hcontext->candidate = candidate_new (key,
 					   9,
 					   list,
 					   hcontext->client_window,
 					   &hcontext->cursor,
 					   hcontext);
+      im_hangul_memory_created(MEMORY_CANDIDATE_WINDOW,
+			       im_hangul_memory_mark() - mark);
   }
   g_free(key);
 }
 
+static void
+popup_candidate_window (GtkIMContextHangul *hcontext)
+{
+  guint64 start;
+
+  if (!(im_hangul_debug_flags & IM_HANGUL_DEBUG_LATENCY)) {
+    popup_candidate_window_real(hcontext);
+    return;
+  }
+
+  start = im_hangul_debug_now();
+  popup_candidate_window_real(hcontext);
+  im_hangul_latency_record(LATENCY_POPUP_CANDIDATE, start);
+}
+
 static void
 close_candidate_window (GtkIMContextHangul *hic)
 {
     if (hic->candidate_string != NULL && hic->candidate_string->len > 0)
 	g_array_set_size(hic->candidate_string, 0);
+    if (hic->candidate != NULL)
+	im_hangul_memory_destroyed(MEMORY_CANDIDATE_WINDOW);
     candidate_delete(hic->candidate);
     hic->candidate = NULL;
 }
 
-static gint
-im_hangul_key_snooper(GtkWidget *widget, GdkEventKey *event, gpointer data)
-{
-  if (current_focused_ic != NULL) {
-    /* Some keys like return, tab, ':' is usually used for auto completion or
-     * commiting some changes. Some application programmers make the program
-     * catch the key before the im module getting the key and check that it is 
-     * return or tab or so. Then the program get the string from the text entry
-     * or textview, so there is no chance for im module to commit the current
-     * string. So in this case, we catch it first and process the filter
-     * function of the input context. Then mostly imhangul will work fine,
-     * I think :) */
-    return im_hangul_ic_filter_keypress(current_focused_ic, event);
-  }
-
-  return FALSE;
-}
-
 void
 im_hangul_init(void)
 {
   hangul_keys = im_hangul_accel_list_new();
   hanja_keys  = im_hangul_accel_list_new();
   
+  im_hangul_debug_flags = g_parse_debug_string(g_getenv("IM_HANGUL_DEBUG"),
+					  im_hangul_debug_keys,
+					  G_N_ELEMENTS(im_hangul_debug_keys));
   im_hangul_config_parse();
 
+  if (im_hangul_debug_flags & IM_HANGUL_DEBUG_SIGNALS)
+    im_hangul_signal_hooks_add();
+
   if (hangul_keys->len == 0) {
     im_hangul_accel_list_append(hangul_keys, GDK_KEY_Hangul, 0);
     im_hangul_accel_list_append(hangul_keys, GDK_KEY_space, GDK_SHIFT_MASK);
@@ -1983,12 +3296,10 @@ im_hangul_init(void)
     im_hangul_accel_list_append(hanja_keys, GDK_KEY_F9, 0);
   }
 
-  /* install gtk key snooper
-   * this is work around code for the problem:
-   *   http://bugzilla.gnome.org/show_bug.cgi?id=62948
-   * I finally decided to install key snooper and catch the keys before the
-   * widget getting it. */
-  snooper_handler_id = gtk_key_snooper_install(im_hangul_key_snooper, NULL);
+  im_hangul_accel_table_build();
+  im_hangul_key_class_table_build();
+
+  toplevel_key_press_hook_add();
 }
 
 void
@@ -1996,11 +3307,7 @@ im_hangul_finalize (void)
 {
   GSList *item;
 
-  /* remove gtk key snooper */
-  if (snooper_handler_id > 0) {
-    gtk_key_snooper_remove(snooper_handler_id);
-    snooper_handler_id = 0;
-  }
+  toplevel_key_press_hook_remove();
 
   /* remove toplevel info */
   for (item = toplevels; item != NULL; item = g_slist_next(item)) {
@@ -2009,11 +3316,32 @@ im_hangul_finalize (void)
   g_slist_free(toplevels);
   toplevels = NULL;
 
+  /* publish the last input mode and remove the screen info */
+  while (input_mode_infos != NULL) {
+    InputModeInfo *info = input_mode_infos->data;
+    input_mode_info_publish (info);
+    g_object_set_data (G_OBJECT(info->screen),
+		       "gtk-imhangul-input-mode-info", NULL);
+  }
+
+  im_hangul_accel_table_free();
+
   im_hangul_accel_list_free(hanja_keys);
   hanja_keys = NULL;
 
   im_hangul_accel_list_free(hangul_keys);
   hangul_keys = NULL;
+
+  if (im_hangul_debug_flags & IM_HANGUL_DEBUG_LATENCY)
+    im_hangul_latency_dump();
+
+  if (im_hangul_debug_flags & IM_HANGUL_DEBUG_SIGNALS) {
+    im_hangul_signal_hooks_remove();
+    im_hangul_signal_dump();
+  }
+
+  if (im_hangul_debug_flags & IM_HANGUL_DEBUG_MEMORY)
+    im_hangul_memory_dump();
 }
 
 /* candidate window */
@@ -2175,8 +3503,9 @@ candidate_set_window_position (Candidate *candidate)
     if (candidate->parent == NULL)
       return;
 
-    gdk_window_get_origin (GDK_WINDOW(candidate->parent), &absx, &absy);
-    height = gdk_window_get_height(GDK_WINDOW(candidate->parent));
+    toplevel_get_window_geometry (candidate->hangul_context->toplevel,
+				  GDK_WINDOW(candidate->parent),
+				  &absx, &absy, &height);
 
     root_w = gdk_screen_width();
     root_h = gdk_screen_height();
@@ -34,6 +34,19 @@ typedef struct _GtkIMContextHangulClass	GtkIMContextHangulClass;
 typedef struct _Candidate               Candidate;
 typedef struct _Toplevel                Toplevel;
 
+/* preedit string buffer, in UCS-4 and UTF-8
+ * libhangul keeps 12 jamo at most, so it never fills up */
+#define IM_HANGUL_PREEDIT_MAX 32
+
+typedef struct _IMHangulPreedit IMHangulPreedit;
+struct _IMHangulPreedit
+{
+  ucschar ucs[IM_HANGUL_PREEDIT_MAX + 1];
+  gchar utf8[IM_HANGUL_PREEDIT_MAX * 6 + 1];
+  gint len;		/* in characters */
+  gint utf8_len;	/* in bytes */
+};
+
 typedef enum
 {
   IM_HANGUL_COMPOSER_2,
@@ -53,10 +66,41 @@ struct _GtkIMContextHangul
   Toplevel *toplevel;
   GdkRectangle cursor;
   guint button_press_handler;
+  guint style_updated_handler;
+  guint size_allocate_handler;
 
   /* hangul ic */
   HangulInputContext* hic;
-  GString* preedit;
+
+  /* preedit points to one of the buffers, the other one keeps the
+   * previous preedit string for comparison */
+  IMHangulPreedit *preedit;
+  IMHangulPreedit preedit_buffers[2];
+
+  /* changes whenever the preedit attributes may change,
+   * preedit_attrs is valid while preedit_attrs_serial is the same */
+  guint preedit_serial;
+  guint preedit_attrs_serial;
+  PangoAttrList *preedit_attrs;
+
+#if GTK_CHECK_VERSION(3, 8, 0)
+  /* preedit_changed waiting for the next frame of the client window */
+  GdkFrameClock *frame_clock;
+  gulong frame_clock_handler;
+#endif
+  gboolean preedit_changed_pending;
+
+  /* commit string and preedit update held back while key events are
+   * waiting in the queue */
+  GString *commit_batch;
+  guint commit_batch_idle;
+  gboolean commit_batching;
+
+  /* the last key event which went through the hangul key path, the widget
+   * gives the same event to filter_keypress if we did not take it */
+  guint32 filtered_key_time;
+  guint16 filtered_key_code;
+  guint filtered_keyval;
 
   /* candidate data */
   Candidate *candidate;
@@ -64,6 +108,13 @@ struct _GtkIMContextHangul
 
   /* options */
   gboolean use_preedit : 1;
+
+  /* the output mode of hic is HANGUL_OUTPUT_JAMO, by capslock */
+  guint output_jamo : 1;
+
+  /* the input purpose of the client is not for hangul text,
+   * all keys go to the slave */
+  guint passthrough : 1;
 };
 
 struct _GtkIMContextHangulClass
@@ -81,6 +132,11 @@ GtkIMContext *gtk_im_context_hangul_new      (void);
 void gtk_im_context_hangul_select_keyboard(GtkIMContextHangul *hcontext,
 		                           const char         *keyboard);
 
+/* key processing: the path the key-press-event hook of the toplevel
+ * takes before the handlers of the window get the key */
+gboolean gtk_im_context_hangul_filter_keypress(GtkIMContextHangul *hcontext,
+					       GdkEventKey        *key);
+
 #endif /* __GTK_IM_CONTEXT_HANGUL_H__ */
 
 /* vim: set sw=2 : */
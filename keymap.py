@@ -0,0 +1,169 @@
+#!/usr/bin/env python
+#
+# Generates imhangul-keymap.h from keymap.txt:
+#   keymap.py keymap.txt > imhangul-keymap.h
+
+import sys
+
+# keysym names of the ascii punctuation, as in keysymdef.h
+punct_names = {
+	' ': 'space',		'!': 'exclam',		'"': 'quotedbl',
+	'#': 'numbersign',	'$': 'dollar',		'%': 'percent',
+	'&': 'ampersand',	"'": 'apostrophe',	'(': 'parenleft',
+	')': 'parenright',	'*': 'asterisk',	'+': 'plus',
+	',': 'comma',		'-': 'minus',		'.': 'period',
+	'/': 'slash',		':': 'colon',		';': 'semicolon',
+	'<': 'less',		'=': 'equal',		'>': 'greater',
+	'?': 'question',	'@': 'at',		'[': 'bracketleft',
+	'\\': 'backslash',	']': 'bracketright',	'^': 'asciicircum',
+	'_': 'underscore',	'`': 'grave',		'{': 'braceleft',
+	'|': 'bar',		'}': 'braceright',	'~': 'asciitilde',
+}
+
+# the keyvals of the layout tables, GDK_KEY_space to GDK_KEY_asciitilde
+first_keyval = 0x20
+last_keyval = 0x7e
+
+def error(filename, lineno, msg):
+	sys.stderr.write('%s:%d: %s\n' % (filename, lineno, msg))
+	sys.exit(1)
+
+def keyval_name(c):
+	if c in punct_names:
+		return 'GDK_KEY_' + punct_names[c]
+	return 'GDK_KEY_' + c
+
+def parse(filename):
+	keys = {}		# keycode: (keyval name, shift keyval name)
+	rows = []		# lists of keycodes
+	layouts = []		# (name, [(unshifted, shifted) for each row])
+
+	layout = None
+	lineno = 0
+	for line in open(filename):
+		lineno += 1
+		line = line.rstrip('\n')
+		if line.strip() == '' or line.startswith('#'):
+			continue
+
+		if line[0].isspace():
+			# a row of the current layout
+			if layout is None:
+				error(filename, lineno, 'a row outside of a layout')
+			fields = line.split()
+			if len(fields) != 2 or len(fields[0]) != len(fields[1]):
+				error(filename, lineno, 'need the unshifted and the shifted keys of the same length')
+			layout[1].append((fields[0], fields[1]))
+			continue
+
+		fields = line.split()
+		if fields[0] == 'key':
+			if len(fields) == 3:
+				fields.append(fields[2])
+			if len(fields) != 4:
+				error(filename, lineno, 'key <keycode> <keyval> [<shift keyval>]')
+			keys[int(fields[1])] = ('GDK_KEY_' + fields[2], 'GDK_KEY_' + fields[3])
+		elif fields[0] == 'row':
+			rows.append([int(k) for k in fields[1:]])
+		elif fields[0] == 'layout':
+			if len(fields) != 2:
+				error(filename, lineno, 'layout <name>')
+			layout = (fields[1], [])
+			layouts.append(layout)
+		else:
+			error(filename, lineno, 'unknown keyword: ' + fields[0])
+
+	if len(layouts) == 0:
+		error(filename, lineno, 'no layout')
+
+	for name, layout_rows in layouts:
+		if len(layout_rows) != len(rows):
+			error(filename, lineno, '%s: %d rows, need %d' % (name, len(layout_rows), len(rows)))
+		for i in range(len(rows)):
+			if len(layout_rows[i][0]) != len(rows[i]):
+				error(filename, lineno, '%s: row %d needs %d keys' % (name, i + 1, len(rows[i])))
+
+	return keys, rows, layouts
+
+def print_keycode_table(keys, rows, qwerty):
+	table = dict(keys)
+	for i in range(len(rows)):
+		for j in range(len(rows[i])):
+			table[rows[i][j]] = (keyval_name(qwerty[i][0][j]), keyval_name(qwerty[i][1][j]))
+
+	out = sys.stdout
+	out.write('/* the keyvals of a US qwerty keyboard, indexed by the hardware keycode\n')
+	out.write(' * and the shift level, 0 if the keycode is not known */\n')
+	out.write('#define IM_HANGUL_KEYCODE_MAX 255\n\n')
+	out.write('static const guint im_hangul_keycode_table[IM_HANGUL_KEYCODE_MAX + 1][2] = {\n')
+	for keycode in sorted(table.keys()):
+		out.write('    [%3d] = { %-22s %-20s},\n' % (keycode,
+			table[keycode][0] + ',', table[keycode][1]))
+	out.write('};\n\n')
+
+def print_layout_tables(rows, layouts):
+	out = sys.stdout
+	qwerty = layouts[0][1]
+
+	out.write('enum {\n')
+	for name, layout_rows in layouts:
+		out.write('    IM_HANGUL_LATIN_LAYOUT_%s,\n' % name.upper())
+	out.write('    IM_HANGUL_LATIN_LAYOUT_LAST\n')
+	out.write('};\n\n')
+
+	out.write('static const char* const im_hangul_latin_layout_names[] = {\n')
+	for name, layout_rows in layouts:
+		out.write('    "%s",\n' % name)
+	out.write('};\n\n')
+
+	# what each layout types at the position of a qwerty key and back
+	to_qwerty = []
+	from_qwerty = []
+	for name, layout_rows in layouts:
+		to_map = {}
+		from_map = {}
+		for i in range(len(rows)):
+			for level in range(2):
+				for j in range(len(rows[i])):
+					c = layout_rows[i][level][j]
+					q = qwerty[i][level][j]
+					to_map[c] = q
+					from_map[q] = c
+		to_qwerty.append((name, to_map))
+		from_qwerty.append((name, from_map))
+
+	for table_name, maps, comment in (
+		('im_hangul_latin_layout_to_qwerty', to_qwerty,
+		 'the qwerty keyval at the position of each keyval of a layout'),
+		('im_hangul_latin_layout_from_qwerty', from_qwerty,
+		 'the keyval of a layout at the position of each qwerty keyval')):
+		out.write('/* %s,\n' % comment)
+		out.write(' * indexed by the keyval - IM_HANGUL_LATIN_LAYOUT_FIRST */\n')
+		out.write('static const guint %s[IM_HANGUL_LATIN_LAYOUT_LAST]\n' % table_name)
+		out.write('    [IM_HANGUL_LATIN_LAYOUT_LENGTH] = {\n')
+		for name, m in maps:
+			out.write('    {   /* %s */\n' % name)
+			for keyval in range(first_keyval, last_keyval + 1):
+				c = chr(keyval)
+				out.write('\t%s,\n' % keyval_name(m.get(c, c)))
+			out.write('    },\n')
+		out.write('};\n\n')
+
+def main():
+	if len(sys.argv) != 2:
+		sys.stderr.write('Usage: keymap.py keymap.txt\n')
+		sys.exit(1)
+
+	keys, rows, layouts = parse(sys.argv[1])
+
+	out = sys.stdout
+	out.write('/* generated by keymap.py from keymap.txt, do not edit */\n\n')
+	out.write('#ifndef IMHANGUL_KEYMAP_H\n')
+	out.write('#define IMHANGUL_KEYMAP_H\n\n')
+	out.write('#define IM_HANGUL_LATIN_LAYOUT_FIRST  0x%02x\n' % first_keyval)
+	out.write('#define IM_HANGUL_LATIN_LAYOUT_LENGTH %d\n\n' % (last_keyval - first_keyval + 1))
+	print_keycode_table(keys, rows, layouts[0][1])
+	print_layout_tables(rows, layouts)
+	out.write('#endif /* IMHANGUL_KEYMAP_H */\n')
+
+main()